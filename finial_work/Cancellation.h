@@ -0,0 +1,50 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+// 协作式取消：CancellationSource 发出取消，持有 CancellationToken 的任务自行检查并尽快退出。
+// 默认构造的 CancellationToken 永远不会被取消。
+
+// 任务检测到取消后抛出的异常
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+class CancellationToken {
+public:
+    CancellationToken() = default;
+
+    bool isCancelled() const {
+        return flag && flag->load(std::memory_order_relaxed);
+    }
+
+    void throwIfCancelled() const {
+        if (isCancelled()) {
+            throw OperationCancelled();
+        }
+    }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(std::shared_ptr<std::atomic<bool>> flag) : flag(std::move(flag)) {}
+
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+class CancellationSource {
+public:
+    CancellationSource() : flag(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() { flag->store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return flag->load(std::memory_order_relaxed); }
+    CancellationToken token() const { return CancellationToken(flag); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag;
+};
+
+#endif // CANCELLATION_H
@@ -0,0 +1,214 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "ThreadPool.h"
+
+// 基于 C++20 协程的任务接口。
+// Task<T> 是惰性协程：被 co_await 时才开始执行，结束后直接切回等待它的协程（对称转移）。
+// 协程在 I/O 处用 co_await blockingCall(...) 挂起，阻塞调用交给专门的 I/O 线程池执行，
+// 完成后再回到计算线程池继续，计算线程不会被磁盘读写占住。
+
+template<typename T = void>
+class Task;
+
+namespace coroutine_detail {
+
+// 协程结束时恢复等待者；没有等待者时什么也不做
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+
+    T take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+}
+
+template<typename T>
+class Task {
+public:
+    using promise_type = coroutine_detail::Promise<T>;
+
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    // co_await 一个 Task：启动它，它结束后恢复当前协程并取得结果（或重新抛出异常）
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{handle};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace coroutine_detail {
+
+template<typename T>
+Task<T> Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// 立即开始执行、结束时自行销毁的协程，用来在非协程代码里启动 Task
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+}
+
+// 在当前线程启动 task，结束时（可能在另一个线程上）调用 onDone，参数为异常或空
+inline coroutine_detail::DetachedTask startDetached(Task<void> task, std::function<void(std::exception_ptr)> onDone) {
+    std::exception_ptr error;
+    try {
+        co_await std::move(task);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    onDone(error);
+}
+
+// co_await resumeOn(pool)：挂起当前协程，由 pool 的工作线程继续执行
+template<typename Pool>
+auto resumeOn(Pool &pool, TaskPriority priority = TaskPriority::RunGeneration) {
+    struct Awaiter {
+        Pool &pool;
+        TaskPriority priority;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([handle] { handle.resume(); }, priority);
+        }
+        void await_resume() noexcept {}
+    };
+    return Awaiter{pool, priority};
+}
+
+// co_await blockingCall(ioPool, cpuPool, fn)：在 ioPool 上执行阻塞调用 fn，
+// 期间当前协程挂起，不占用计算线程；fn 完成后回到 cpuPool 继续，返回 fn 的结果。
+template<typename IoPool, typename CpuPool, typename F>
+auto blockingCall(IoPool &ioPool, CpuPool &cpuPool, F fn, TaskPriority priority = TaskPriority::RunGeneration) {
+    using Result = std::invoke_result_t<F &>;
+
+    struct Awaiter {
+        IoPool &ioPool;
+        CpuPool &cpuPool;
+        F fn;
+        TaskPriority priority;
+        std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>> result{};
+        std::exception_ptr error{};
+
+        bool await_ready() noexcept { return false; }
+
+        // 挂起期间 Awaiter 保存在协程帧里，I/O 线程可以直接使用 this
+        void await_suspend(std::coroutine_handle<> handle) {
+            ioPool.submit([this, handle] {
+                try {
+                    if constexpr (std::is_void_v<Result>) {
+                        fn();
+                    } else {
+                        result.emplace(fn());
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                cpuPool.submit([handle] { handle.resume(); }, priority);
+            });
+        }
+
+        Result await_resume() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            if constexpr (!std::is_void_v<Result>) {
+                return std::move(*result);
+            }
+        }
+    };
+    return Awaiter{ioPool, cpuPool, std::move(fn), priority};
+}
+
+#endif // COROUTINE_H
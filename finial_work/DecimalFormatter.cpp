@@ -0,0 +1,83 @@
+#include "DecimalFormatter.h"
+#include <cstring>
+
+namespace {
+
+constexpr char kDigitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// 从 end 往前写出 value 的全部数字，返回第一个数字的位置
+inline char *writeDigitsBackward(uint32_t value, char *end) {
+    while (value >= 100) {
+        uint32_t pair = value % 100;
+        value /= 100;
+        end -= 2;
+        std::memcpy(end, kDigitPairs + pair * 2, 2);
+    }
+    if (value >= 10) {
+        end -= 2;
+        std::memcpy(end, kDigitPairs + value * 2, 2);
+    } else {
+        *--end = static_cast<char>('0' + value);
+    }
+    return end;
+}
+
+// 从 end 往前写出恰好 8 位数字（不足补零）
+inline char *writeEightDigitsBackward(uint32_t value, char *end) {
+    for (int i = 0; i < 4; ++i) {
+        uint32_t pair = value % 100;
+        value /= 100;
+        end -= 2;
+        std::memcpy(end, kDigitPairs + pair * 2, 2);
+    }
+    return end;
+}
+
+inline char *formatLine(int64_t value, char *out) {
+    uint64_t magnitude = static_cast<uint64_t>(value);
+    if (value < 0) {
+        *out++ = '-';
+        magnitude = 0 - magnitude;
+    }
+
+    // 数字先写到临时区的末尾，再定长复制 20 字节，避免按长度分支
+    char digits[40];
+    char *end = digits + 20;
+    char *first;
+    if (magnitude < 100000000) {
+        first = writeDigitsBackward(static_cast<uint32_t>(magnitude), end);
+    } else {
+        first = writeEightDigitsBackward(static_cast<uint32_t>(magnitude % 100000000), end);
+        magnitude /= 100000000;
+        if (magnitude < 100000000) {
+            first = writeDigitsBackward(static_cast<uint32_t>(magnitude), first);
+        } else {
+            first = writeEightDigitsBackward(static_cast<uint32_t>(magnitude % 100000000), first);
+            first = writeDigitsBackward(static_cast<uint32_t>(magnitude / 100000000), first);
+        }
+    }
+
+    size_t length = static_cast<size_t>(end - first);
+    std::memcpy(out, first, 20);
+    out[length] = '\n';
+    return out + length + 1;
+}
+
+}
+
+char *formatDecimalLines(const int64_t *values, size_t count, char *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out = formatLine(values[i], out);
+    }
+    return out;
+}
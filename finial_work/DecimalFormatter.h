@@ -0,0 +1,17 @@
+#ifndef DECIMALFORMATTER_H
+#define DECIMALFORMATTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 批量把 int64 格式化为十进制文本，每个数后跟一个换行。
+// 用两位数字查表，每次除以 100 产出两位；8 位以内的部分只用 32 位运算。
+// 直接写入调用方的大缓冲区，不经过 iostream。
+
+// 每行最多写入的字节数（符号、19 位数字、换行，再加上定长复制多写的余量）
+constexpr size_t kMaxDecimalLineBytes = 21;
+
+// 把 count 个数逐行写入 out，返回写入结束的位置；out 至少要有 count * kMaxDecimalLineBytes 字节
+char *formatDecimalLines(const int64_t *values, size_t count, char *out);
+
+#endif // DECIMALFORMATTER_H
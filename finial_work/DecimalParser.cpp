@@ -0,0 +1,280 @@
+#include "DecimalParser.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECIMAL_PARSER_X86 1
+#endif
+
+namespace {
+
+constexpr uint64_t kMaxNegativeMagnitude = uint64_t(1) << 63;
+constexpr uint64_t kOverflowThreshold = std::numeric_limits<uint64_t>::max() / 10;
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+inline bool isDigit(char c) {
+    return static_cast<unsigned char>(c - '0') <= 9;
+}
+
+// 从 pos 开始继续累加数字，超出 uint64 时置 overflow，但仍然读完所有数字
+inline const char *accumulateDigits(const char *pos, const char *end, uint64_t &magnitude, bool &overflow) {
+    while (pos != end && isDigit(*pos)) {
+        uint64_t digit = static_cast<uint64_t>(*pos - '0');
+        // 等价于 magnitude * 10 + digit > UINT64_MAX，只用比较
+        if (magnitude >= kOverflowThreshold && (magnitude > kOverflowThreshold || digit > 5)) {
+            overflow = true;
+        }
+        magnitude = magnitude * 10 + digit;
+        ++pos;
+    }
+    return pos;
+}
+
+[[noreturn]] void throwMalformed(const std::string &sourceName) {
+    throw std::runtime_error("Malformed data in input file: " + sourceName);
+}
+
+[[noreturn]] void throwOutOfRange(const std::string &sourceName) {
+    throw std::runtime_error("Integer out of int64 range in input file: " + sourceName);
+}
+
+// 逐字符解析
+struct ScalarDigits {
+    static constexpr size_t kWindow = 0;
+
+    static const char *parse(const char *pos, const char *end, uint64_t &magnitude, bool &overflow) {
+        magnitude = 0;
+        return accumulateDigits(pos, end, magnitude, overflow);
+    }
+};
+
+#ifdef DECIMAL_PARSER_X86
+
+// 把 digits（已减去 '0'）开头的 count（1..16）位数字转换成整数：
+// 先右移对齐到 16 字节末尾、左侧补零，再逐级两两乘加：1 位 -> 2 位 -> 4 位 -> 8 位
+__attribute__((target("sse4.1"))) inline uint64_t convertDigits16(__m128i digits, size_t count) {
+    const __m128i identity = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    // 下标为负的位置 pshufb 填 0
+    __m128i shift = _mm_add_epi8(identity, _mm_set1_epi8(static_cast<char>(static_cast<int>(count) - 16)));
+    __m128i aligned = _mm_shuffle_epi8(digits, shift);
+
+    __m128i pairs = _mm_maddubs_epi16(aligned, _mm_set1_epi16(0x010A));      // d0 * 10 + d1
+    __m128i quads = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00010064));       // p0 * 100 + p1
+    __m128i packed = _mm_packus_epi32(quads, quads);
+    __m128i octets = _mm_madd_epi16(packed, _mm_set1_epi32(0x00012710));     // q0 * 10000 + q1
+
+    uint64_t high = static_cast<uint32_t>(_mm_cvtsi128_si32(octets));
+    uint64_t low = static_cast<uint32_t>(_mm_extract_epi32(octets, 1));
+    return high * 100000000 + low;
+}
+
+// 一次检查 16 个字节找出数字长度
+struct Sse41Digits {
+    static constexpr size_t kWindow = 16;
+
+    __attribute__((target("sse4.1"))) static const char *parse(const char *pos, const char *end, uint64_t &magnitude, bool &overflow) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+        __m128i digits = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+        __m128i isDigitMask = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(isDigitMask));
+        size_t count = static_cast<size_t>(__builtin_ctz(~mask | 0x10000u));
+        if (count == 0) {
+            magnitude = 0;
+            return pos;
+        }
+        magnitude = convertDigits16(digits, count);
+        if (count < 16) {
+            return pos + count;
+        }
+        return accumulateDigits(pos + 16, end, magnitude, overflow);
+    }
+};
+
+// 一次检查 32 个字节，int64 的 19 位数字连同符号和分隔符一次就能看完
+struct Avx2Digits {
+    static constexpr size_t kWindow = 32;
+
+    __attribute__((target("avx2"))) static const char *parse(const char *pos, const char *end, uint64_t &magnitude, bool &overflow) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pos));
+        __m256i digits = _mm256_sub_epi8(bytes, _mm256_set1_epi8('0'));
+        __m256i isDigitMask = _mm256_cmpeq_epi8(_mm256_min_epu8(digits, _mm256_set1_epi8(9)), digits);
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(isDigitMask));
+        size_t count = static_cast<size_t>(__builtin_ctzll(~mask | (uint64_t(1) << 32)));
+        if (count == 0) {
+            magnitude = 0;
+            return pos;
+        }
+        size_t head = std::min<size_t>(count, 16);
+        magnitude = convertDigits16(_mm256_castsi256_si128(digits), head);
+        if (count < 32) {
+            // 16 位以后的数字（最多十几位）逐个累加
+            return accumulateDigits(pos + head, pos + count, magnitude, overflow);
+        }
+        return accumulateDigits(pos + head, end, magnitude, overflow);
+    }
+};
+
+#endif
+
+// 主循环：剩余字节足够一个窗口时用 Digits 解析数字，末尾不足一个窗口的部分逐字符解析
+template<typename Digits>
+__attribute__((always_inline)) inline void parseLoop(const char *pos, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    while (true) {
+        while (pos != end && isSpace(*pos)) {
+            ++pos;
+        }
+        if (pos == end) {
+            break;
+        }
+
+        bool negative = false;
+        if (*pos == '-' || *pos == '+') {
+            negative = (*pos == '-');
+            ++pos;
+        }
+
+        uint64_t magnitude;
+        bool overflow = false;
+        const char *next;
+        if (static_cast<size_t>(end - pos) >= Digits::kWindow) {
+            next = Digits::parse(pos, end, magnitude, overflow);
+        } else {
+            next = ScalarDigits::parse(pos, end, magnitude, overflow);
+        }
+
+        if (next == pos || (next != end && !isSpace(*next))) {
+            throwMalformed(sourceName);
+        }
+        if (overflow || magnitude > (negative ? kMaxNegativeMagnitude : kMaxNegativeMagnitude - 1)) {
+            throwOutOfRange(sourceName);
+        }
+        // C++20 中无符号数到有符号数的转换按补码回绕，-2^63 也能正确得到
+        out.push_back(negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude));
+        pos = next;
+    }
+}
+
+void parseScalar(const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    parseLoop<ScalarDigits>(begin, end, out, sourceName);
+}
+
+#ifdef DECIMAL_PARSER_X86
+
+__attribute__((target("sse4.1"))) void parseSse41(const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    parseLoop<Sse41Digits>(begin, end, out, sourceName);
+}
+
+__attribute__((target("avx2"))) void parseAvx2(const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    parseLoop<Avx2Digits>(begin, end, out, sourceName);
+}
+
+#endif
+
+bool cpuSupports(DecimalParserKind kind) {
+#ifdef DECIMAL_PARSER_X86
+    switch (kind) {
+    case DecimalParserKind::Avx2:
+        return __builtin_cpu_supports("avx2");
+    case DecimalParserKind::Sse41:
+        return __builtin_cpu_supports("sse4.1");
+    default:
+        return true;
+    }
+#else
+    return kind == DecimalParserKind::Scalar;
+#endif
+}
+
+DecimalParserKind detectParser() {
+    if (cpuSupports(DecimalParserKind::Avx2)) {
+        return DecimalParserKind::Avx2;
+    }
+    if (cpuSupports(DecimalParserKind::Sse41)) {
+        return DecimalParserKind::Sse41;
+    }
+    return DecimalParserKind::Scalar;
+}
+
+}
+
+DecimalParserKind activeDecimalParser() {
+    static const DecimalParserKind kind = detectParser();
+    return kind;
+}
+
+const char *decimalParserName(DecimalParserKind kind) {
+    switch (kind) {
+    case DecimalParserKind::Avx2:
+        return "avx2";
+    case DecimalParserKind::Sse41:
+        return "sse4.1";
+    default:
+        return "scalar";
+    }
+}
+
+void parseDecimalInts(DecimalParserKind kind, const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    if (!cpuSupports(kind)) {
+        kind = DecimalParserKind::Scalar;
+    }
+#ifdef DECIMAL_PARSER_X86
+    if (kind == DecimalParserKind::Avx2) {
+        parseAvx2(begin, end, out, sourceName);
+        return;
+    }
+    if (kind == DecimalParserKind::Sse41) {
+        parseSse41(begin, end, out, sourceName);
+        return;
+    }
+#endif
+    parseScalar(begin, end, out, sourceName);
+}
+
+void parseDecimalInts(const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName) {
+    parseDecimalInts(activeDecimalParser(), begin, end, out, sourceName);
+}
+
+DecimalReader::DecimalReader(const std::string &path, size_t bufferBytes)
+    : path(path), file(path, std::ios::binary), position(0), blockBytes(std::max<size_t>(bufferBytes, 64)) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Error opening input file: " + path);
+    }
+}
+
+bool DecimalReader::refill() {
+    values.clear();
+    position = 0;
+    while (values.empty()) {
+        if (!file) {
+            if (!text.empty()) {
+                // 文件末尾最后一个数后面没有换行
+                parseDecimalInts(text.data(), text.data() + text.size(), values, path);
+                text.clear();
+                continue;
+            }
+            return false;
+        }
+
+        size_t carried = text.size();
+        text.resize(carried + blockBytes);
+        file.read(text.data() + carried, static_cast<std::streamsize>(blockBytes));
+        text.resize(carried + static_cast<size_t>(file.gcount()));
+        if (file.bad()) {
+            throw std::runtime_error("Error reading input file: " + path);
+        }
+
+        // 只解析到最后一个空白为止，被块边界截断的数留到下一块
+        size_t cut = text.size();
+        while (cut > 0 && !isSpace(text[cut - 1])) {
+            --cut;
+        }
+        parseDecimalInts(text.data(), text.data() + cut, values, path);
+        text.erase(0, cut);
+    }
+    return true;
+}
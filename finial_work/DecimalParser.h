@@ -0,0 +1,57 @@
+#ifndef DECIMALPARSER_H
+#define DECIMALPARSER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// 批量解析以空白分隔的十进制 int64 文本。
+// 数字部分用 SSE4.1 / AVX2 一次处理 16 位，运行时按 CPU 支持的指令集选择实现，
+// 不支持时退回标量实现。每个数必须是可选的正负号加数字，后面紧跟空白或文本结尾；
+// 格式错误或超出 int64 范围时抛出 std::runtime_error。
+
+enum class DecimalParserKind {
+    Scalar,
+    Sse41,
+    Avx2
+};
+
+// 当前 CPU 上使用的实现
+DecimalParserKind activeDecimalParser();
+const char *decimalParserName(DecimalParserKind kind);
+
+// 解析 [begin, end) 中的所有整数并追加到 out，sourceName 用于错误信息
+void parseDecimalInts(const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName);
+
+// 指定实现的版本，CPU 不支持该指令集时退回标量实现
+void parseDecimalInts(DecimalParserKind kind, const char *begin, const char *end, std::vector<int64_t> &out, const std::string &sourceName);
+
+// 分块读取文本文件并解析，内存占用与文件大小无关
+class DecimalReader {
+public:
+    explicit DecimalReader(const std::string &path, size_t bufferBytes = 1 << 20);
+
+    DecimalReader(const DecimalReader &) = delete;
+    DecimalReader &operator=(const DecimalReader &) = delete;
+
+    bool next(int64_t &value) {
+        if (position == values.size() && !refill()) {
+            return false;
+        }
+        value = values[position++];
+        return true;
+    }
+
+private:
+    std::string path;
+    std::ifstream file;
+    std::string text;             // 读入的文本块，开头是上一块末尾没有解析完的数
+    std::vector<int64_t> values;  // 当前块解析出的数
+    size_t position;
+    size_t blockBytes;
+
+    bool refill();
+};
+
+#endif // DECIMALPARSER_H
@@ -0,0 +1,47 @@
+#include "LoserTree.h"
+
+LoserTree::LoserTree(const std::vector<RunReader *> &readers, bool callerRefills)
+    : inputs(readers.size()), losers(readers.size()), live(readers.size()), callerRefills(callerRefills), starved(kNone), draining(false) {
+    const size_t k = readers.size();
+    if (k == 0) {
+        return;
+    }
+
+    // 自底向上比一遍：winners[k + i] 是叶子 i，每个内部节点记下败者，胜者继续向上比
+    std::vector<Player> winners(2 * k);
+    for (size_t i = 0; i < k; ++i) {
+        inputs[i].reader = readers[i];
+        inputs[i].finished = false;
+        winners[k + i] = {loadBlock(i) ? *inputs[i].position : INT64_MAX, i};
+    }
+    for (size_t node = k - 1; node > 0; --node) {
+        const Player &left = winners[2 * node];
+        const Player &right = winners[2 * node + 1];
+        bool leftWins = left.key <= right.key;
+        winners[node] = leftWins ? left : right;
+        losers[node] = leftWins ? right : left;
+    }
+    losers[0] = winners[1];
+}
+
+bool LoserTree::loadBlock(size_t index) {
+    Input &input = inputs[index];
+    size_t n = input.reader->nextBlock(input.position);
+    if (n == 0) {
+        input.position = input.end = nullptr;
+        input.finished = true;
+        --live;
+        return false;
+    }
+    input.end = input.position + n;
+    return true;
+}
+
+void LoserTree::resume() {
+    size_t index = starved;
+    starved = kNone;
+    bool hasData = loadBlock(index);
+    if (!draining) {
+        replay({hasData ? *inputs[index].position : INT64_MAX, index});
+    }
+}
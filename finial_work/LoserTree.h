@@ -0,0 +1,151 @@
+#ifndef LOSERTREE_H
+#define LOSERTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "RunFormat.h"
+
+// 败者树多路合并：叶子是各个输入 run，内部节点保存那一场比赛的败者，losers[0] 是冠军，也就是当前最小值。
+// 每输出一个数只需沿冠军所在的叶子到根重赛一次，共 log k 次比较（二叉堆弹出再压入约要 2 log k 次），
+// 重赛只比较值并用条件传送交换，没有难以预测的分支。读完的输入变成值为 INT64_MAX 的哨兵，树的形状不变：
+// 哨兵成为冠军时其余输入剩下的也只有 INT64_MAX，直接整段写出即可。
+// 各输入直接在 RunReader 的缓冲区上前进，读完一段再整段取下一段；只剩一个输入时不再比较，把它剩下的数整段写出。
+// callerRefills 为 true 时败者树自己不读文件：某个输入的缓冲区取完、需要读文件时 writeNext 提前返回，
+// 调用方（在 I/O 线程上）对 starvedReader() 调用 refill，再调用 resume 接着合并
+class LoserTree {
+public:
+    // readers 的生命周期必须覆盖整个合并过程；从各 reader 的当前位置开始读。
+    // callerRefills 为 true 时各 reader 在构造前都要处于 ready() 状态
+    explicit LoserTree(const std::vector<RunReader *> &readers, bool callerRefills = false);
+
+    LoserTree(const LoserTree &) = delete;
+    LoserTree &operator=(const LoserTree &) = delete;
+
+    // 还有数据没有输出
+    bool hasNext() const { return live > 0; }
+
+    // 按从小到大输出最多 count 个数，返回实际输出的个数，全部输出后返回 0。
+    // 需要等待调用方读文件时提前返回，此时 starvedReader() 不为空
+    template<typename Writer>
+    size_t writeNext(Writer &writer, size_t count);
+
+    // 等待读文件的输入，没有时为 nullptr
+    RunReader *starvedReader() const { return starved == kNone ? nullptr : inputs[starved].reader; }
+
+    // starvedReader() 已经 refill 过（或已经读完），取它的下一段数据继续合并
+    void resume();
+
+private:
+    struct Input {
+        RunReader *reader;
+        const int64_t *position;
+        const int64_t *end;
+        bool finished;
+    };
+
+    // 参赛者：输入的当前值连同编号一起存在节点里，重赛时不必再按编号去取值
+    struct Player {
+        int64_t key;
+        size_t index;
+    };
+
+    static constexpr size_t kNone = SIZE_MAX;
+
+    std::vector<Input> inputs;
+    std::vector<Player> losers;  // losers[1..k-1] 是内部节点，叶子 i 的父节点是 (i + k) / 2
+    size_t live;
+    bool callerRefills;
+    size_t starved;  // 等待调用方读文件的输入，kNone 表示没有
+    bool draining;   // 不再比较，剩下的数按输入逐个整段写出
+
+    // 取下一段数据，读完时把输入变成哨兵；返回是否还有数据
+    bool loadBlock(size_t index);
+
+    // 输入的当前一段取完了：需要调用方读文件时记下它并返回 false，否则取下一段，返回是否还有数据
+    bool nextBlockOrStarve(size_t index, bool &hasData) {
+        if (callerRefills && !inputs[index].reader->ready()) {
+            starved = index;
+            return false;
+        }
+        hasData = loadBlock(index);
+        return true;
+    }
+
+    // 冠军所在的输入前进一步，再从它的叶子到根重赛；需要等待读文件时暂停，resume 时再重赛
+    void advanceWinner() {
+        Player winner = losers[0];
+        Input &input = inputs[winner.index];
+        if (++input.position != input.end) {
+            winner.key = *input.position;
+        } else {
+            bool hasData;
+            if (!nextBlockOrStarve(winner.index, hasData)) {
+                return;
+            }
+            winner.key = hasData ? *input.position : INT64_MAX;
+        }
+        replay(winner);
+    }
+
+    // winner 带着新的值从它的叶子到根重赛
+    void replay(Player winner) {
+        for (size_t node = (winner.index + inputs.size()) / 2; node > 0; node /= 2) {
+            // 用掩码交换，避免编译器把条件选择又改回分支
+            Player &challenger = losers[node];
+            uint64_t mask = 0 - static_cast<uint64_t>(challenger.key < winner.key);
+            uint64_t keyDiff = (static_cast<uint64_t>(challenger.key) ^ static_cast<uint64_t>(winner.key)) & mask;
+            size_t indexDiff = (challenger.index ^ winner.index) & mask;
+            challenger.key = static_cast<int64_t>(static_cast<uint64_t>(challenger.key) ^ keyDiff);
+            winner.key = static_cast<int64_t>(static_cast<uint64_t>(winner.key) ^ keyDiff);
+            challenger.index ^= indexDiff;
+            winner.index ^= indexDiff;
+        }
+        losers[0] = winner;
+    }
+
+    // 按输入的顺序把剩下的数整段写出，最多 count 个
+    template<typename Writer>
+    size_t drain(Writer &writer, size_t count) {
+        size_t written = 0;
+        for (size_t i = 0; i < inputs.size() && written < count; ++i) {
+            Input &input = inputs[i];
+            while (!input.finished && written < count) {
+                size_t n = std::min(static_cast<size_t>(input.end - input.position), count - written);
+                writer.writeBlock(input.position, n);
+                input.position += n;
+                written += n;
+                bool hasData;
+                if (input.position == input.end && !nextBlockOrStarve(i, hasData)) {
+                    return written;
+                }
+            }
+        }
+        return written;
+    }
+};
+
+template<typename Writer>
+size_t LoserTree::writeNext(Writer &writer, size_t count) {
+    size_t written = 0;
+    while (written < count && live > 1 && !draining && starved == kNone) {
+        if (inputs[losers[0].index].finished) {
+            // 哨兵获胜：剩下的全是 INT64_MAX
+            draining = true;
+            break;
+        }
+        writer.write(losers[0].key);
+        ++written;
+        advanceWinner();
+    }
+    if (live == 1) {
+        draining = true;
+    }
+    if (draining && starved == kNone) {
+        written += drain(writer, count - written);
+    }
+    return written;
+}
+
+#endif // LOSERTREE_H
@@ -0,0 +1,69 @@
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <vector>
+
+void MemoryLease::reset() {
+    if (budget) {
+        budget->release(bytes);
+        budget = nullptr;
+        bytes = 0;
+    }
+}
+
+MemoryBudget::MemoryBudget(size_t limitBytes) : limitBytes(limitBytes), usedBytes(0), peakBytes(0) {}
+
+void MemoryBudget::grantLocked(size_t bytes) {
+    usedBytes += bytes;
+    peakBytes = std::max(peakBytes, usedBytes);
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // 有人排队时不插队，避免大额申请一直等不到
+    if (!waiters.empty() || usedBytes + bytes > limitBytes) {
+        return false;
+    }
+    grantLocked(bytes);
+    return true;
+}
+
+bool MemoryBudget::acquireOrWait(size_t bytes, TaskFunction onGranted) {
+    if (bytes > limitBytes) {
+        throw std::invalid_argument("Memory request of " + std::to_string(bytes) +
+                                    " bytes exceeds the budget of " + std::to_string(limitBytes) + " bytes");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (waiters.empty() && usedBytes + bytes <= limitBytes) {
+        grantLocked(bytes);
+        return true;
+    }
+    waiters.push_back({bytes, std::move(onGranted)});
+    return false;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    std::vector<TaskFunction> granted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        usedBytes -= bytes;
+        // 按排队顺序批准，队首放不下时后面的也继续等
+        while (!waiters.empty() && usedBytes + waiters.front().bytes <= limitBytes) {
+            grantLocked(waiters.front().bytes);
+            granted.push_back(std::move(waiters.front().onGranted));
+            waiters.pop_front();
+        }
+    }
+    for (auto &onGranted : granted) {
+        onGranted();
+    }
+}
+
+size_t MemoryBudget::used() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return usedBytes;
+}
+
+size_t MemoryBudget::peak() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakBytes;
+}
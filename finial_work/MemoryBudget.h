@@ -0,0 +1,105 @@
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include "ThreadPool.h"
+
+// 进程级内存预算：排序、合并用到的大缓冲区都必须先从这里申请额度，
+// 所有已批准额度之和不超过上限。额度不足时申请者按先来先得的顺序排队，
+// 协程在 co_await 处挂起，不占用工作线程；每个任务只在开始时申请一次，
+// 持有额度期间不再申请新的额度，因此不会出现互相等待。
+
+class MemoryBudget;
+
+// 已批准的一份额度，析构时归还
+class MemoryLease {
+public:
+    MemoryLease() = default;
+    MemoryLease(MemoryBudget *budget, size_t bytes) : budget(budget), bytes(bytes) {}
+    MemoryLease(MemoryLease &&other) noexcept
+        : budget(std::exchange(other.budget, nullptr)), bytes(std::exchange(other.bytes, 0)) {}
+    MemoryLease &operator=(MemoryLease &&other) noexcept {
+        if (this != &other) {
+            reset();
+            budget = std::exchange(other.budget, nullptr);
+            bytes = std::exchange(other.bytes, 0);
+        }
+        return *this;
+    }
+    MemoryLease(const MemoryLease &) = delete;
+    MemoryLease &operator=(const MemoryLease &) = delete;
+    ~MemoryLease() { reset(); }
+
+    size_t size() const { return bytes; }
+    void reset();
+
+private:
+    MemoryBudget *budget = nullptr;
+    size_t bytes = 0;
+};
+
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limitBytes);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    // 额度足够且没有人在排队时立即批准
+    bool tryAcquire(size_t bytes);
+
+    // 立即批准时返回 true；否则登记 onGranted，额度归还后（在归还额度的线程上）调用它。
+    // 申请超过上限时抛出 std::invalid_argument
+    bool acquireOrWait(size_t bytes, TaskFunction onGranted);
+
+    void release(size_t bytes);
+
+    size_t limit() const { return limitBytes; }
+    size_t used() const;
+    size_t peak() const;
+
+private:
+    struct Waiter {
+        size_t bytes;
+        TaskFunction onGranted;
+    };
+
+    const size_t limitBytes;
+    mutable std::mutex mutex;
+    size_t usedBytes;
+    size_t peakBytes;
+    std::deque<Waiter> waiters;
+
+    void grantLocked(size_t bytes);
+};
+
+// co_await acquireMemory(budget, pool, bytes)：得到一份 MemoryLease。
+// 额度不足时挂起，批准后由 pool 的工作线程继续执行
+template<typename Pool>
+auto acquireMemory(MemoryBudget &budget, Pool &pool, size_t bytes, TaskPriority priority = TaskPriority::RunGeneration) {
+    struct Awaiter {
+        MemoryBudget &budget;
+        Pool &pool;
+        size_t bytes;
+        TaskPriority priority;
+
+        bool await_ready() { return budget.tryAcquire(bytes); }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            bool granted = budget.acquireOrWait(bytes, [pool = &pool, handle, priority = priority] {
+                pool->submit([handle] { handle.resume(); }, priority);
+            });
+            return !granted;
+        }
+
+        MemoryLease await_resume() { return MemoryLease(&budget, bytes); }
+    };
+    return Awaiter{budget, pool, bytes, priority};
+}
+
+#endif // MEMORYBUDGET_H
@@ -0,0 +1,109 @@
+#include "ReplacementSelection.h"
+#include <algorithm>
+#include <utility>
+
+ReplacementSelection::ReplacementSelection(std::vector<int64_t> &storage, size_t writerBufferBytes, std::function<std::string()> nextRunPath)
+    : heap(storage), capacity(std::max<size_t>(storage.capacity(), 1)), heapSize(0), writerBufferBytes(writerBufferBytes),
+      nextRunPath(std::move(nextRunPath)) {
+    heap.clear();
+}
+
+void ReplacementSelection::siftDown(size_t index) {
+    int64_t value = heap[index];
+    while (true) {
+        size_t child = 2 * index + 1;
+        if (child >= heapSize) {
+            break;
+        }
+        if (child + 1 < heapSize && heap[child + 1] < heap[child]) {
+            ++child;
+        }
+        if (value <= heap[child]) {
+            break;
+        }
+        heap[index] = heap[child];
+        index = child;
+    }
+    heap[index] = value;
+}
+
+void ReplacementSelection::heapify() {
+    heapSize = heap.size();
+    for (size_t i = heapSize / 2; i-- > 0;) {
+        siftDown(i);
+    }
+}
+
+void ReplacementSelection::emit(int64_t value) {
+    if (!writer) {
+        paths.push_back(nextRunPath());
+        writer = std::make_unique<RunWriter>(paths.back(), writerBufferBytes);
+    }
+    writer->write(value);
+}
+
+// 当前 run 的数已经全部输出：关闭它，尾部积攒的数组成下一个 run 的堆
+void ReplacementSelection::startNextRun() {
+    if (writer) {
+        writer->close();
+        writer.reset();
+    }
+    heapify();
+}
+
+void ReplacementSelection::add(const int64_t *values, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        int64_t value = values[i];
+
+        // 先把数组填满，再开始输出
+        if (heap.size() < capacity) {
+            heap.push_back(value);
+            if (heap.size() == capacity) {
+                heapify();
+            }
+            continue;
+        }
+
+        if (heapSize == 0) {
+            startNextRun();
+        }
+        int64_t smallest = heap[0];
+        emit(smallest);
+        if (value >= smallest) {
+            // 仍然属于当前 run，替换堆顶
+            heap[0] = value;
+        } else {
+            // 属于下一个 run：堆缩小一格，腾出的位置存放这个数
+            heap[0] = heap[heapSize - 1];
+            heap[heapSize - 1] = value;
+            --heapSize;
+        }
+        if (heapSize > 0) {
+            siftDown(0);
+        }
+    }
+}
+
+void ReplacementSelection::finish() {
+    if (heap.size() < capacity) {
+        heapify();  // 输入不足一个堆
+    }
+    while (!heap.empty()) {
+        if (heapSize == 0) {
+            startNextRun();
+        }
+        emit(heap[0]);
+        // 堆顶由堆的最后一个数顶替，腾出的位置由数组的最后一个数（下一个 run 的数）填上
+        heap[0] = heap[heapSize - 1];
+        heap[heapSize - 1] = heap.back();
+        heap.pop_back();
+        --heapSize;
+        if (heapSize > 0) {
+            siftDown(0);
+        }
+    }
+    if (writer) {
+        writer->close();
+        writer.reset();
+    }
+}
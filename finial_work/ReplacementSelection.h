@@ -0,0 +1,48 @@
+#ifndef REPLACEMENTSELECTION_H
+#define REPLACEMENTSELECTION_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "RunFormat.h"
+
+// 置换选择生成 run：内存中维护一个能放 capacity 个数的最小堆，不断输出堆顶并读入新数，
+// 新数不小于刚输出的数时留在当前 run，否则放到下一个 run。
+// 随机输入时 run 的平均长度约为 2 * capacity，输入接近有序时整个输入只产生一个 run。
+// 下一个 run 的数存放在堆数组的尾部，每个数只占 8 字节。
+// 堆数组由调用方提供，容量就是堆的大小；结束后数组被清空，容量保留以便复用。
+class ReplacementSelection {
+public:
+    // storage 用作堆数组；nextRunPath 为每个新 run 返回文件路径；writerBufferBytes 为写 run 的缓冲区大小
+    ReplacementSelection(std::vector<int64_t> &storage, size_t writerBufferBytes, std::function<std::string()> nextRunPath);
+
+    ReplacementSelection(const ReplacementSelection &) = delete;
+    ReplacementSelection &operator=(const ReplacementSelection &) = delete;
+
+    // 输入一批数
+    void add(const int64_t *values, size_t count);
+
+    // 输入结束：输出剩余的数并关闭最后一个 run
+    void finish();
+
+    // 已经生成的 run 文件
+    const std::vector<std::string> &runPaths() const { return paths; }
+
+private:
+    std::vector<int64_t> &heap;  // [0, heapSize) 是当前 run 的堆，[heapSize, size) 是下一个 run 的数
+    size_t capacity;
+    size_t heapSize;
+    size_t writerBufferBytes;
+    std::function<std::string()> nextRunPath;
+    std::unique_ptr<RunWriter> writer;
+    std::vector<std::string> paths;
+
+    void siftDown(size_t index);
+    void heapify();
+    void emit(int64_t value);
+    void startNextRun();
+};
+
+#endif // REPLACEMENTSELECTION_H
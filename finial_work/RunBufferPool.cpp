@@ -0,0 +1,117 @@
+#include "RunBufferPool.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+void RunBufferHandle::reset() {
+    if (pool) {
+        pool->giveBack(buffer);
+        pool = nullptr;
+        buffer = nullptr;
+    }
+}
+
+RunBufferPool::RunBufferPool(MemoryBudget &budget, size_t buffers, size_t valuesPerBuffer, bool withScratch,
+                             std::vector<int> workerNodes, std::function<size_t()> currentWorker)
+    : bufferValues(valuesPerBuffer), withScratch(withScratch), workerNodes(std::move(workerNodes)),
+      currentWorker(std::move(currentWorker)), freeByWorker(this->workerNodes.size() + 1), freeCount(buffers) {
+    size_t bytes = buffers * valuesPerBuffer * sizeof(int64_t) * (withScratch ? 2 : 1);
+    if (!budget.tryAcquire(bytes)) {
+        throw std::invalid_argument("Run buffers of " + std::to_string(bytes) + " bytes do not fit in the memory budget");
+    }
+    lease = MemoryLease(&budget, bytes);
+
+    // 缓冲区还没有分配内存，都先放进非工作线程的列表，由第一次取用的工作线程预留
+    for (size_t i = 0; i < buffers; ++i) {
+        storage.push_back(std::make_unique<RunBuffer>());
+        freeByWorker.back().push_back(storage.back().get());
+    }
+}
+
+RunBuffer *RunBufferPool::takeLocked() {
+    if (freeCount == 0) {
+        return nullptr;
+    }
+    size_t worker = std::min(currentWorker(), freeByWorker.size() - 1);
+    auto *list = &freeByWorker[worker];
+    int node = worker < workerNodes.size() ? workerNodes[worker] : -1;
+    if (list->empty() && node >= 0) {
+        for (size_t other = 0; other < workerNodes.size(); ++other) {
+            if (workerNodes[other] == node && !freeByWorker[other].empty()) {
+                list = &freeByWorker[other];
+                break;
+            }
+        }
+    }
+    if (list->empty()) {
+        for (auto &other : freeByWorker) {
+            if (!other.empty()) {
+                list = &other;
+                break;
+            }
+        }
+    }
+    RunBuffer *buffer = list->back();
+    list->pop_back();
+    --freeCount;
+    return buffer;
+}
+
+// 第一次取出时按满容量预留，之后容量保持不变
+void RunBufferPool::prepare(RunBuffer *buffer) {
+    buffer->values.reserve(bufferValues);
+    if (withScratch) {
+        buffer->scratch.reserve(bufferValues);
+    }
+}
+
+RunBuffer *RunBufferPool::tryTake() {
+    RunBuffer *buffer;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 有人排队时不插队
+        if (!waiters.empty()) {
+            return nullptr;
+        }
+        buffer = takeLocked();
+    }
+    if (buffer) {
+        prepare(buffer);
+    }
+    return buffer;
+}
+
+bool RunBufferPool::takeOrWait(RunBuffer *&slot, TaskFunction onAvailable) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (waiters.empty()) {
+            slot = takeLocked();
+        }
+        if (!slot) {
+            waiters.push_back({&slot, std::move(onAvailable)});
+            return false;
+        }
+    }
+    prepare(slot);
+    return true;
+}
+
+void RunBufferPool::giveBack(RunBuffer *buffer) {
+    buffer->values.clear();
+    buffer->scratch.clear();
+    TaskFunction onAvailable;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (waiters.empty()) {
+            freeByWorker[std::min(currentWorker(), freeByWorker.size() - 1)].push_back(buffer);
+            ++freeCount;
+            return;
+        }
+        // 直接交给排在最前面的等待者
+        *waiters.front().slot = buffer;
+        onAvailable = std::move(waiters.front().onAvailable);
+        waiters.pop_front();
+    }
+    prepare(buffer);
+    onAvailable();
+}
@@ -0,0 +1,127 @@
+#ifndef RUNBUFFERPOOL_H
+#define RUNBUFFERPOOL_H
+
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "MemoryBudget.h"
+#include "ThreadPool.h"
+
+// 排序任务的 run 缓冲区池：每个缓冲区第一次被取出时就按满容量预留，任务写完 run 后归还，
+// 下一个任务直接复用已经写过的页面，不再重新分配、扩容复制和触发缺页。
+// 归还的缓冲区放进当前工作线程的空闲列表，取用时优先取本线程的（页面在本地 NUMA 节点上），
+// 其次取同一 NUMA 节点上其他线程的，最后才取其他节点的。池在创建时从内存预算中为全部缓冲区申请一份常驻额度，
+// 缓冲区个数因此限制了同时排序的任务数；缓冲区都在使用中时，取用者按先来先得的顺序排队。
+
+// 一个 run 缓冲区：数据数组和（基数排序、双调排序用的）辅助数组，取出时都是空的
+struct RunBuffer {
+    std::vector<int64_t> values;
+    std::vector<int64_t> scratch;
+};
+
+class RunBufferPool;
+
+// 取出的缓冲区，析构时归还
+class RunBufferHandle {
+public:
+    RunBufferHandle() = default;
+    RunBufferHandle(RunBufferPool *pool, RunBuffer *buffer) : pool(pool), buffer(buffer) {}
+    RunBufferHandle(RunBufferHandle &&other) noexcept
+        : pool(std::exchange(other.pool, nullptr)), buffer(std::exchange(other.buffer, nullptr)) {}
+    RunBufferHandle &operator=(RunBufferHandle &&other) noexcept {
+        if (this != &other) {
+            reset();
+            pool = std::exchange(other.pool, nullptr);
+            buffer = std::exchange(other.buffer, nullptr);
+        }
+        return *this;
+    }
+    RunBufferHandle(const RunBufferHandle &) = delete;
+    RunBufferHandle &operator=(const RunBufferHandle &) = delete;
+    ~RunBufferHandle() { reset(); }
+
+    RunBuffer *operator->() const { return buffer; }
+    void reset();
+
+private:
+    RunBufferPool *pool = nullptr;
+    RunBuffer *buffer = nullptr;
+};
+
+class RunBufferPool {
+public:
+    // buffers 个缓冲区，每个能放 valuesPerBuffer 个数，withScratch 时另带同样大小的辅助数组；
+    // workerNodes 是各工作线程所在的 NUMA 节点（未知时为 -1），个数即工作线程数 workers；
+    // currentWorker 返回当前线程的编号（0..workers-1，其他线程返回 workers）。
+    // 预算中放不下全部缓冲区时抛出 std::invalid_argument
+    RunBufferPool(MemoryBudget &budget, size_t buffers, size_t valuesPerBuffer, bool withScratch,
+                  std::vector<int> workerNodes, std::function<size_t()> currentWorker);
+
+    RunBufferPool(const RunBufferPool &) = delete;
+    RunBufferPool &operator=(const RunBufferPool &) = delete;
+
+    // 有空闲缓冲区且没有人在排队时立即取出
+    RunBuffer *tryTake();
+
+    // 立即取到时返回 true 并写入 slot；否则登记，有缓冲区归还时写入 slot，
+    // 再（在归还缓冲区的线程上）调用 onAvailable
+    bool takeOrWait(RunBuffer *&slot, TaskFunction onAvailable);
+
+    void giveBack(RunBuffer *buffer);
+
+    size_t valuesPerBuffer() const { return bufferValues; }
+
+private:
+    struct Waiter {
+        RunBuffer **slot;
+        TaskFunction onAvailable;
+    };
+
+    MemoryLease lease;
+    size_t bufferValues;
+    bool withScratch;
+    std::vector<int> workerNodes;
+    std::function<size_t()> currentWorker;
+    std::vector<std::unique_ptr<RunBuffer>> storage;
+    std::mutex mutex;
+    std::vector<std::vector<RunBuffer *>> freeByWorker;  // 最后一项属于非工作线程
+    size_t freeCount;
+    std::deque<Waiter> waiters;
+
+    RunBuffer *takeLocked();
+    void prepare(RunBuffer *buffer);
+};
+
+// co_await takeRunBuffer(buffers, pool)：得到一个 RunBufferHandle。
+// 缓冲区都在使用中时挂起，有缓冲区归还后由 pool 的工作线程继续执行
+template<typename Pool>
+auto takeRunBuffer(RunBufferPool &buffers, Pool &pool, TaskPriority priority = TaskPriority::RunGeneration) {
+    struct Awaiter {
+        RunBufferPool &buffers;
+        Pool &pool;
+        TaskPriority priority;
+        RunBuffer *buffer = nullptr;
+
+        bool await_ready() {
+            buffer = buffers.tryTake();
+            return buffer != nullptr;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            bool taken = buffers.takeOrWait(buffer, [pool = &pool, handle, priority = priority] {
+                pool->submit([handle] { handle.resume(); }, priority);
+            });
+            return !taken;
+        }
+
+        RunBufferHandle await_resume() { return RunBufferHandle(&buffers, buffer); }
+    };
+    return Awaiter{buffers, pool, priority};
+}
+
+#endif // RUNBUFFERPOOL_H
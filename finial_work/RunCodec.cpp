@@ -0,0 +1,153 @@
+#include "RunCodec.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RUN_CODEC_X86 1
+#endif
+
+namespace {
+
+constexpr size_t kSlotsPerLane = kCodecBlockValues / 4;
+
+inline uint64_t loadLittle64(const char *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+inline void storeLittle64(char *p, uint64_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    std::memcpy(p, &value, sizeof(value));
+}
+
+inline uint64_t widthMask(unsigned width) {
+    return width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+}
+
+void decodeScalar(const char *words, unsigned width, uint64_t base, int64_t *out) {
+    const uint64_t mask = widthMask(width);
+    uint64_t value = base;
+    for (size_t slot = 0; slot < kSlotsPerLane; ++slot) {
+        size_t offset = slot * width;
+        size_t word = offset / 64;
+        unsigned shift = offset % 64;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            uint64_t delta = 0;
+            if (width != 0) {
+                delta = loadLittle64(words + (word * 4 + lane) * 8) >> shift;
+                if (shift + width > 64) {
+                    delta |= loadLittle64(words + ((word + 1) * 4 + lane) * 8) << (64 - shift);
+                }
+                delta &= mask;
+            }
+            value += delta;
+            out[slot * 4 + lane] = static_cast<int64_t>(value);
+        }
+    }
+}
+
+#ifdef RUN_CODEC_X86
+
+// 一次解出 4 个差值并求前缀和：相邻 4 个差值恰好在 4 条字流的同一个槽里
+__attribute__((target("avx2"))) void decodeAvx2(const char *words, unsigned width, uint64_t base, int64_t *out) {
+    const __m256i mask = _mm256_set1_epi64x(static_cast<long long>(widthMask(width)));
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = _mm256_set1_epi64x(static_cast<long long>(base));
+    for (size_t slot = 0; slot < kSlotsPerLane; ++slot) {
+        size_t offset = slot * width;
+        size_t word = offset / 64;
+        unsigned shift = offset % 64;
+        __m256i deltas = _mm256_setzero_si256();
+        if (width != 0) {
+            __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + word * 32));
+            deltas = _mm256_srl_epi64(low, _mm_cvtsi32_si128(static_cast<int>(shift)));
+            if (shift + width > 64) {
+                __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(words + (word + 1) * 32));
+                deltas = _mm256_or_si256(deltas, _mm256_sll_epi64(high, _mm_cvtsi32_si128(static_cast<int>(64 - shift))));
+            }
+            deltas = _mm256_and_si256(deltas, mask);
+        }
+        // 寄存器内前缀和：先加上左移一格的自己，再加上左移两格的结果
+        __m256i sums = _mm256_add_epi64(deltas, _mm256_blend_epi32(_mm256_permute4x64_epi64(deltas, 0x90), zero, 0x03));
+        sums = _mm256_add_epi64(sums, _mm256_blend_epi32(_mm256_permute4x64_epi64(sums, 0x40), zero, 0x0F));
+        sums = _mm256_add_epi64(sums, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + slot * 4), sums);
+        carry = _mm256_permute4x64_epi64(sums, 0xFF);
+    }
+}
+
+bool useAvx2() {
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+}
+
+#endif
+
+}
+
+size_t encodeRunBlock(const int64_t *values, size_t count, char *out) {
+    uint64_t deltas[kCodecBlockValues] = {};
+    uint64_t bits = 0;
+    for (size_t i = 1; i < count; ++i) {
+        deltas[i] = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]);
+        bits |= deltas[i];
+    }
+    unsigned width = bits == 0 ? 0 : 64 - static_cast<unsigned>(__builtin_clzll(bits));
+
+    size_t bytes = encodedBlockBytes(width);
+    out[0] = static_cast<char>(width);
+    storeLittle64(out + 1, static_cast<uint64_t>(values[0]));
+    char *words = out + 9;
+    std::memset(words, 0, bytes - 9);
+    if (width == 0) {
+        return bytes;
+    }
+    // 字流的字在内存中按 4 条交错存放；先在本地按字拼好，最后统一写成小端
+    uint64_t packed[kCodecBlockValues] = {};
+    for (size_t i = 0; i < kCodecBlockValues; ++i) {
+        size_t lane = i % 4;
+        size_t offset = (i / 4) * width;
+        size_t word = offset / 64;
+        unsigned shift = offset % 64;
+        packed[word * 4 + lane] |= deltas[i] << shift;
+        if (shift + width > 64) {
+            packed[(word + 1) * 4 + lane] |= deltas[i] >> (64 - shift);
+        }
+    }
+    for (size_t i = 0; i < (bytes - 9) / 8; ++i) {
+        storeLittle64(words + i * 8, packed[i]);
+    }
+    return bytes;
+}
+
+CodecIsa activeCodecIsa() {
+#if defined(RUN_CODEC_X86) && !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    if (useAvx2()) {
+        return CodecIsa::Avx2;
+    }
+#endif
+    return CodecIsa::Scalar;
+}
+
+size_t decodeRunBlock(const char *in, int64_t *out) {
+    return decodeRunBlock(activeCodecIsa(), in, out);
+}
+
+size_t decodeRunBlock(CodecIsa isa, const char *in, int64_t *out) {
+    unsigned width = static_cast<unsigned char>(in[0]);
+    uint64_t base = loadLittle64(in + 1);
+#if defined(RUN_CODEC_X86) && !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    if (isa == CodecIsa::Avx2 && useAvx2()) {
+        decodeAvx2(in + 9, width, base, out);
+        return encodedBlockBytes(width);
+    }
+#endif
+    decodeScalar(in + 9, width, base, out);
+    return encodedBlockBytes(width);
+}
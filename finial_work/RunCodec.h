@@ -0,0 +1,47 @@
+#ifndef RUNCODEC_H
+#define RUNCODEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 有序 run 的压缩编码：每 128 个数一块，块内记录第一个数（基准）和相邻两数之差，
+// 差值按块内最大差值所需的位数紧凑存放（帧参考 + 增量 + 位打包）。
+// 块的布局：1 字节位宽 w，8 字节小端基准值，随后 4 条交错的 64 位字流，
+// 第 i 个差值（第 0 个为 0）放在第 i % 4 条字流的第 i / 4 个 w 位槽中。
+// 4 条字流的位偏移总是相同，解码时一个 AVX2 寄存器同时移位、截取 4 个差值，再做前缀和。
+// 差值按无符号 64 位回绕计算，任意序列都能还原；有序数据的差值小，位宽远小于 64。
+
+enum class RunCodec {
+    Raw,         // 每个数固定 8 字节
+    DeltaPacked  // 按块增量 + 位打包
+};
+
+constexpr size_t kCodecBlockValues = 128;
+
+// 块头 9 字节，位宽为 64 时数据 1024 字节
+constexpr size_t kMaxEncodedBlockBytes = 9 + kCodecBlockValues * sizeof(int64_t);
+
+// 位宽为 width 的块占用的字节数
+constexpr size_t encodedBlockBytes(unsigned width) {
+    return 9 + 4 * sizeof(uint64_t) * ((kCodecBlockValues / 4 * width + 63) / 64);
+}
+
+// 编码 count（1..128）个数到 out（至少 kMaxEncodedBlockBytes 字节），返回写入的字节数
+size_t encodeRunBlock(const int64_t *values, size_t count, char *out);
+
+// 解码使用的指令集，运行时按 CPU 支持情况选择
+enum class CodecIsa {
+    Scalar,
+    Avx2
+};
+
+CodecIsa activeCodecIsa();
+
+// 从 in 解码一块，总是写出 128 个数（不满一块时末尾重复最后一个数），返回读取的字节数。
+// 调用方需保证 in 中有 encodedBlockBytes(in[0]) 字节
+size_t decodeRunBlock(const char *in, int64_t *out);
+
+// 用指定的指令集解码（测试时对比两种实现），CPU 不支持时退回标量实现
+size_t decodeRunBlock(CodecIsa isa, const char *in, int64_t *out);
+
+#endif // RUNCODEC_H
@@ -0,0 +1,300 @@
+#include "RunFormat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+// 文件头开头的 8 字节 magic 区分编码方式："TPSRUN1\0" 是 Raw，"TPSRUNP\0" 是 DeltaPacked
+constexpr char kRunMagic[8] = {'T', 'P', 'S', 'R', 'U', 'N', '1', '\0'};
+constexpr char kPackedRunMagic[8] = {'T', 'P', 'S', 'R', 'U', 'N', 'P', '\0'};
+
+// 磁盘上固定为小端；大端机器上读写时逐个交换字节序
+inline void toDiskOrder(int64_t *values, size_t count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<int64_t>(__builtin_bswap64(static_cast<uint64_t>(values[i])));
+    }
+#else
+    (void)values;
+    (void)count;
+#endif
+}
+
+inline void headerToDiskOrder(RunHeader &header) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    header.count = __builtin_bswap64(header.count);
+    toDiskOrder(&header.min, 1);
+    toDiskOrder(&header.max, 1);
+#else
+    (void)header;
+#endif
+}
+
+// 压缩数据暂存区从缓冲区中划出，至少放得下两个块
+size_t stagingBytesFor(size_t bufferBytes) {
+    return std::clamp(bufferBytes / 8, 2 * kMaxEncodedBlockBytes, kCodecStagingBytes);
+}
+
+// 压缩编码时缓冲区按整块计，至少一块
+size_t elementsFor(size_t bufferBytes, RunCodec codec) {
+    if (codec == RunCodec::Raw) {
+        return std::max<size_t>(1, bufferBytes / sizeof(int64_t));
+    }
+    size_t elements = (bufferBytes - std::min(bufferBytes, stagingBytesFor(bufferBytes))) / sizeof(int64_t);
+    return std::max(kCodecBlockValues, elements - elements % kCodecBlockValues);
+}
+
+}
+
+RunWriter::RunWriter(const std::string &path, size_t bufferBytes, RunCodec codec)
+    : path(path), file(path, std::ios::binary | std::ios::trunc), codec(codec), closed(false) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open run file for writing: " + path);
+    }
+    buffer.reserve(elementsFor(bufferBytes, codec));
+    if (codec == RunCodec::DeltaPacked) {
+        staging.resize(stagingBytesFor(bufferBytes));
+    }
+    std::memcpy(header.magic, codec == RunCodec::DeltaPacked ? kPackedRunMagic : kRunMagic, sizeof(header.magic));
+    header.count = 0;
+    header.min = 0;
+    header.max = 0;
+    // 先占位，close 时再回填真实的文件头
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+RunWriter::~RunWriter() {
+    // 没有正常 close 的 run 不完整，直接删除
+    if (!closed) {
+        file.close();
+        std::remove(path.c_str());
+    }
+}
+
+void RunWriter::writeBlock(const int64_t *values, size_t count) {
+    // 压缩编码时比缓冲区还大的数据整块直接编码，不再复制到缓冲区
+    if (codec == RunCodec::DeltaPacked && buffer.empty() && count > buffer.capacity()) {
+        size_t direct = count - count % kCodecBlockValues;
+        writePacked(values, direct);
+        values += direct;
+        count -= direct;
+    }
+#if !(defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    // 小端机器上比缓冲区还大的数据块直接写出，不再复制一遍
+    if (codec == RunCodec::Raw && count > buffer.capacity()) {
+        flush();
+        if (header.count == 0) {
+            header.min = values[0];
+        }
+        header.max = values[count - 1];
+        header.count += count;
+        file.write(reinterpret_cast<const char *>(values), static_cast<std::streamsize>(count * sizeof(int64_t)));
+        if (!file) {
+            throw std::runtime_error("Failed to write run file: " + path);
+        }
+        return;
+    }
+#endif
+    while (count > 0) {
+        if (buffer.size() == buffer.capacity()) {
+            flush();
+        }
+        size_t n = std::min(count, buffer.capacity() - buffer.size());
+        buffer.insert(buffer.end(), values, values + n);
+        values += n;
+        count -= n;
+    }
+}
+
+void RunWriter::flush(bool final) {
+    if (buffer.empty()) {
+        return;
+    }
+    if (codec == RunCodec::DeltaPacked) {
+        size_t count = final ? buffer.size() : buffer.size() - buffer.size() % kCodecBlockValues;
+        if (count > 0) {
+            writePacked(buffer.data(), count);
+            buffer.erase(buffer.begin(), buffer.begin() + static_cast<std::ptrdiff_t>(count));
+        }
+        return;
+    }
+    if (header.count == 0) {
+        header.min = buffer.front();
+    }
+    header.max = buffer.back();
+    header.count += buffer.size();
+    toDiskOrder(buffer.data(), buffer.size());
+    file.write(reinterpret_cast<const char *>(buffer.data()),
+               static_cast<std::streamsize>(buffer.size() * sizeof(int64_t)));
+    buffer.clear();
+    if (!file) {
+        throw std::runtime_error("Failed to write run file: " + path);
+    }
+}
+
+void RunWriter::writePacked(const int64_t *values, size_t count) {
+    if (header.count == 0) {
+        header.min = values[0];
+    }
+    header.max = values[count - 1];
+    header.count += count;
+
+    size_t used = 0;
+    for (size_t i = 0; i < count; i += kCodecBlockValues) {
+        if (staging.size() - used < kMaxEncodedBlockBytes) {
+            file.write(staging.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+        used += encodeRunBlock(values + i, std::min(kCodecBlockValues, count - i), staging.data() + used);
+    }
+    file.write(staging.data(), static_cast<std::streamsize>(used));
+    if (!file) {
+        throw std::runtime_error("Failed to write run file: " + path);
+    }
+}
+
+void RunWriter::close() {
+    flush(true);
+    RunHeader diskHeader = header;
+    headerToDiskOrder(diskHeader);
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&diskHeader), sizeof(diskHeader));
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write run file: " + path);
+    }
+    closed = true;
+}
+
+RunReader::RunReader(const std::string &path, size_t bufferBytes)
+    : path(path), file(path, std::ios::binary), position(0), remaining(0), codec(RunCodec::Raw), stagingBegin(0), stagingEnd(0) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open run file: " + path);
+    }
+    file.read(reinterpret_cast<char *>(&runHeader), sizeof(runHeader));
+    if (file && std::memcmp(runHeader.magic, kPackedRunMagic, sizeof(kPackedRunMagic)) == 0) {
+        codec = RunCodec::DeltaPacked;
+    } else if (!file || std::memcmp(runHeader.magic, kRunMagic, sizeof(kRunMagic)) != 0) {
+        throw std::runtime_error("Not a run file: " + path);
+    }
+    headerToDiskOrder(runHeader);
+    remaining = runHeader.count;
+    buffer.reserve(elementsFor(bufferBytes, codec));
+    if (codec == RunCodec::DeltaPacked) {
+        staging.resize(stagingBytesFor(bufferBytes));
+    }
+}
+
+bool RunReader::refill() {
+    if (remaining == 0) {
+        return false;
+    }
+    if (codec == RunCodec::DeltaPacked) {
+        refillPacked();
+        return true;
+    }
+    size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.capacity()));
+    buffer.resize(n);
+    file.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(n * sizeof(int64_t)));
+    if (!file) {
+        throw std::runtime_error("Truncated run file: " + path);
+    }
+    toDiskOrder(buffer.data(), n);
+    remaining -= n;
+    position = 0;
+    return true;
+}
+
+// 解码尽可能多的整块填满缓冲区；压缩数据不足一块时先把剩余部分移到开头再从文件读入
+void RunReader::refillPacked() {
+    buffer.resize(buffer.capacity());
+    size_t produced = 0;
+    while (remaining > 0 && buffer.size() - produced >= kCodecBlockValues) {
+        size_t blockBytes = stagingEnd - stagingBegin > 0 ? encodedBlockBytes(static_cast<unsigned char>(staging[stagingBegin])) : 1;
+        if (stagingEnd - stagingBegin < blockBytes) {
+            std::memmove(staging.data(), staging.data() + stagingBegin, stagingEnd - stagingBegin);
+            stagingEnd -= stagingBegin;
+            stagingBegin = 0;
+            file.read(staging.data() + stagingEnd, static_cast<std::streamsize>(staging.size() - stagingEnd));
+            size_t got = static_cast<size_t>(file.gcount());
+            stagingEnd += got;
+            if (file.bad() || got == 0) {
+                throw std::runtime_error("Truncated run file: " + path);
+            }
+            continue;
+        }
+        if (static_cast<unsigned char>(staging[stagingBegin]) > 64) {
+            throw std::runtime_error("Corrupt run file: " + path);
+        }
+        stagingBegin += decodeRunBlock(staging.data() + stagingBegin, buffer.data() + produced);
+        size_t n = static_cast<size_t>(std::min<uint64_t>(remaining, kCodecBlockValues));
+        produced += n;
+        remaining -= n;
+    }
+    buffer.resize(produced);
+    position = 0;
+}
+
+size_t RunReader::peekBlock(const int64_t *&values) {
+    if (position == buffer.size() && !refill()) {
+        return 0;
+    }
+    values = buffer.data() + position;
+    return buffer.size() - position;
+}
+
+size_t RunReader::nextBlock(const int64_t *&values) {
+    if (position == buffer.size() && !refill()) {
+        return 0;
+    }
+    values = buffer.data() + position;
+    size_t n = buffer.size() - position;
+    position = buffer.size();
+    return n;
+}
+
+TextWriter::TextWriter(const std::string &path, size_t bufferBytes)
+    : path(path), file(path, std::ios::trunc),
+      buffer(std::max<size_t>(bufferBytes, kMaxDecimalLineBytes * 64)), used(0) {
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+}
+
+void TextWriter::writeBlock(const int64_t *values, size_t count) {
+    while (count > 0) {
+        if (room() == 0) {
+            flush();
+            continue;
+        }
+        size_t n = std::min(count, room());
+        used = static_cast<size_t>(formatDecimalLines(values, n, buffer.data() + used) - buffer.data());
+        values += n;
+        count -= n;
+    }
+}
+
+void TextWriter::flush() {
+    file.write(buffer.data(), static_cast<std::streamsize>(used));
+    used = 0;
+    if (!file) {
+        throw std::runtime_error("Failed to write output file: " + path);
+    }
+}
+
+void TextWriter::close() {
+    flush();
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write output file: " + path);
+    }
+}
+
+void writeRun(const std::string &path, const std::vector<int64_t> &values) {
+    // 整块直接写出（或直接编码），只需要最小的缓冲区
+    RunWriter writer(path, sizeof(int64_t));
+    writer.writeBlock(values.data(), values.size());
+    writer.close();
+}
@@ -0,0 +1,169 @@
+#ifndef RUNFORMAT_H
+#define RUNFORMAT_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "DecimalFormatter.h"
+#include "RunCodec.h"
+
+// 中间有序文件（run）的二进制格式：32 字节文件头，随后是 count 个小端 int64（Raw），
+// 或者按 RunCodec.h 编码的压缩块（DeltaPacked，文件头的 magic 不同）。
+// 与十进制文本相比，读写都不需要解析和格式化。只有最终输出（以及原始输入）使用文本。
+
+struct RunHeader {
+    char magic[8];   // 标识编码方式
+    uint64_t count;  // 数据个数
+    int64_t min;     // 最小值（count 为 0 时无意义）
+    int64_t max;     // 最大值（count 为 0 时无意义）
+};
+
+static_assert(sizeof(RunHeader) == 32, "RunHeader must be 32 bytes on disk");
+
+// 合并阶段输出的格式
+enum class OutputFormat {
+    BinaryRun,  // 中间文件
+    Text        // 最终输出，每行一个十进制数
+};
+
+// 读写缓冲区默认大小
+constexpr size_t kRunBufferBytes = 1 << 20;
+
+// 写中间 run 时使用的编码；读取时按文件头自动识别。
+// 压缩后每趟合并读写的字节数减少，磁盘带宽是瓶颈时更快，代价是编码、解码的少量计算
+constexpr RunCodec kTempRunCodec = RunCodec::DeltaPacked;
+
+// 编码、解码时暂存压缩数据的缓冲区的上限，从读写缓冲区中划出
+constexpr size_t kCodecStagingBytes = 64 << 10;
+
+// RunReader、RunWriter 实际占用的最小缓冲区：至少一个块加上两个块的暂存区。
+// 给定的 bufferBytes 不小于它时实际占用不超过 bufferBytes，更小时按它分配
+constexpr size_t kMinRunBufferBytes = kCodecBlockValues * sizeof(int64_t) + 2 * kMaxEncodedBlockBytes;
+
+// 顺序写入一个 run：数据先进入缓冲区，close 时补写文件头
+class RunWriter {
+public:
+    explicit RunWriter(const std::string &path, size_t bufferBytes = kRunBufferBytes, RunCodec codec = kTempRunCodec);
+    ~RunWriter();
+
+    RunWriter(const RunWriter &) = delete;
+    RunWriter &operator=(const RunWriter &) = delete;
+
+    void write(int64_t value) {
+        if (buffer.size() == buffer.capacity()) {
+            flush();
+        }
+        buffer.push_back(value);
+    }
+
+    // 写入一段已排序的数据；不超过 room() 个数时只进入缓冲区，不写文件
+    void writeBlock(const int64_t *values, size_t count);
+
+    // 缓冲区还能放下的数的个数，为 0 时下一次写入会先写文件
+    size_t room() const { return buffer.capacity() - buffer.size(); }
+
+    // 写出缓冲区中的数据；final 为 false 时压缩编码只写出整块，不满一块的尾部留在缓冲区。
+    // 失败时抛出 std::runtime_error
+    void flush(bool final = false);
+
+    // 刷新缓冲区并写入文件头；失败时抛出 std::runtime_error
+    void close();
+
+private:
+    std::string path;
+    std::ofstream file;
+    std::vector<int64_t> buffer;
+    RunHeader header;
+    RunCodec codec;
+    bool closed;
+    std::vector<char> staging;  // 压缩后待写出的数据
+
+    void writeRaw(const int64_t *values, size_t count);
+    void writePacked(const int64_t *values, size_t count);
+};
+
+// 顺序读取一个 run
+class RunReader {
+public:
+    explicit RunReader(const std::string &path, size_t bufferBytes = kRunBufferBytes);
+
+    RunReader(const RunReader &) = delete;
+    RunReader &operator=(const RunReader &) = delete;
+
+    const RunHeader &header() const { return runHeader; }
+
+    bool next(int64_t &value) {
+        if (position == buffer.size() && !refill()) {
+            return false;
+        }
+        value = buffer[position++];
+        return true;
+    }
+
+    // 取出缓冲区中剩余的一整段数据，返回个数；读完时返回 0
+    size_t nextBlock(const int64_t *&values);
+
+    // 查看缓冲区中剩余的一整段数据但不取出，返回个数；读完时返回 0
+    size_t peekBlock(const int64_t *&values);
+
+    // 取出 peekBlock 看到的前 count 个数
+    void consume(size_t count) { position += count; }
+
+    // 缓冲区中还有数据，或者文件已经读完：此时 next、nextBlock、peekBlock 都不会读文件
+    bool ready() const { return position < buffer.size() || remaining == 0; }
+
+    // 缓冲区取完后读入下一段数据，文件读完时返回 false。
+    // 合并时由 I/O 线程调用，计算线程只处理已经读入的数据
+    bool refill();
+
+private:
+    std::string path;
+    std::ifstream file;
+    std::vector<int64_t> buffer;
+    size_t position;
+    uint64_t remaining;  // 文件中尚未读入缓冲区的个数
+    RunHeader runHeader;
+    RunCodec codec;
+    std::vector<char> staging;  // 读入的、尚未解码的压缩数据
+    size_t stagingBegin;
+    size_t stagingEnd;
+
+    void refillPacked();
+};
+
+// 顺序写入十进制文本，每行一个数；数字直接格式化进缓冲区，不经过 iostream
+class TextWriter {
+public:
+    explicit TextWriter(const std::string &path, size_t bufferBytes = kRunBufferBytes);
+
+    TextWriter(const TextWriter &) = delete;
+    TextWriter &operator=(const TextWriter &) = delete;
+
+    void write(int64_t value) {
+        if (room() == 0) {
+            flush();
+        }
+        used = static_cast<size_t>(formatDecimalLines(&value, 1, buffer.data() + used) - buffer.data());
+    }
+
+    // 不超过 room() 个数时只格式化进缓冲区，不写文件
+    void writeBlock(const int64_t *values, size_t count);
+
+    // 缓冲区还能放下的数的个数（按最长的一行计）
+    size_t room() const { return (buffer.size() - used) / kMaxDecimalLineBytes; }
+
+    void flush();
+    void close();
+
+private:
+    std::string path;
+    std::ofstream file;
+    std::vector<char> buffer;
+    size_t used;
+};
+
+// 把整个有序数组写成一个 run，不额外分配缓冲区
+void writeRun(const std::string &path, const std::vector<int64_t> &values);
+
+#endif // RUNFORMAT_H
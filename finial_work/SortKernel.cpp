@@ -0,0 +1,542 @@
+#include "SortKernel.h"
+#include <algorithm>
+#include <array>
+#include <memory>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SORT_KERNEL_X86 1
+#endif
+
+namespace {
+
+// 数据量小于这个值时基数排序的直方图开销不划算，直接用 std::sort
+constexpr size_t kRadixMinSize = 4096;
+
+constexpr uint64_t kSignBit = uint64_t(1) << 63;
+
+// 所有趟的直方图的字节数
+template<unsigned Bits>
+constexpr size_t radixHistogramBytes() {
+    return (64 + Bits - 1) / Bits * (size_t(1) << Bits) * sizeof(size_t);
+}
+
+template<unsigned Bits>
+void radixSortImpl(std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    constexpr unsigned kPasses = (64 + Bits - 1) / Bits;
+    constexpr size_t kBuckets = size_t(1) << Bits;
+    constexpr uint64_t kMask = kBuckets - 1;
+
+    const size_t count = data.size();
+    scratch.resize(count);
+
+    // 一次扫描统计所有趟的直方图；16 位时直方图有 2MB，放在堆上，每个线程只分配一次
+    thread_local std::unique_ptr<std::array<size_t, kBuckets>[]> histograms;
+    if (!histograms) {
+        histograms = std::make_unique<std::array<size_t, kBuckets>[]>(kPasses);
+    } else {
+        for (unsigned pass = 0; pass < kPasses; ++pass) {
+            histograms[pass].fill(0);
+        }
+    }
+    for (int64_t value : data) {
+        uint64_t key = static_cast<uint64_t>(value) ^ kSignBit;
+        for (unsigned pass = 0; pass < kPasses; ++pass) {
+            ++histograms[pass][(key >> (pass * Bits)) & kMask];
+        }
+    }
+
+    int64_t *source = data.data();
+    int64_t *target = scratch.data();
+    for (unsigned pass = 0; pass < kPasses; ++pass) {
+        auto &histogram = histograms[pass];
+        const unsigned shift = pass * Bits;
+
+        // 这一位在所有数上都相同，这一趟不会改变顺序
+        uint64_t firstDigit = ((static_cast<uint64_t>(source[0]) ^ kSignBit) >> shift) & kMask;
+        if (histogram[firstDigit] == count) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+            size_t bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            int64_t value = source[i];
+            uint64_t digit = ((static_cast<uint64_t>(value) ^ kSignBit) >> shift) & kMask;
+            target[histogram[digit]++] = value;
+        }
+        std::swap(source, target);
+    }
+
+    // 结果落在辅助数组上时交换两个数组，不用再复制一遍
+    if (source != data.data()) {
+        data.swap(scratch);
+    }
+}
+
+
+// 双调排序在块内归并的数据量：数据和辅助数组各 8KB，一起放进 L1
+constexpr size_t kBitonicBlockValues = 1024;
+
+// 数据量小于这个值时直接用 std::sort
+constexpr size_t kBitonicMinSize = 64;
+
+// 把不足一个寄存器的尾部 [sortedCount, count) 排序后从后往前并入前面的有序部分，每个数最多移动一次
+void mergeTail(int64_t *values, size_t sortedCount, size_t count) {
+    std::sort(values + sortedCount, values + count);
+    int64_t tail[16];
+    size_t tailCount = count - sortedCount;
+    std::copy(values + sortedCount, values + count, tail);
+    size_t i = sortedCount;
+    size_t k = count;
+    while (tailCount > 0) {
+        if (i > 0 && values[i - 1] > tail[tailCount - 1]) {
+            values[--k] = values[--i];
+        } else {
+            values[--k] = tail[--tailCount];
+        }
+    }
+}
+
+// 找出自然有序段，把降序段就地反转，bounds 记录各段的边界。整数相等即不可区分，
+// 降序段允许有相等的数（timsort 为保持稳定只接受严格降序，带重复值的逆序输入会被切成很多段）。
+// 段数超过 kMaxNaturalRuns 时提前返回 false
+bool findNaturalRuns(std::vector<int64_t> &data, std::vector<size_t> &bounds, size_t &reversedRuns) {
+    const size_t count = data.size();
+    bounds.assign(1, 0);
+    reversedRuns = 0;
+    size_t begin = 0;
+    while (begin < count) {
+        if (bounds.size() > kMaxNaturalRuns) {
+            return false;
+        }
+        // 先跳过开头的相等值，再按第一个不同的数判断方向，否则以相等值开头的降序段会被拆成很多段
+        size_t end = begin + 1;
+        while (end < count && data[end] == data[begin]) {
+            ++end;
+        }
+        if (end < count && data[end] < data[begin]) {
+            while (end < count && data[end] <= data[end - 1]) {
+                ++end;
+            }
+            std::reverse(data.begin() + static_cast<std::ptrdiff_t>(begin), data.begin() + static_cast<std::ptrdiff_t>(end));
+            ++reversedRuns;
+        } else {
+            while (end < count && data[end] >= data[end - 1]) {
+                ++end;
+            }
+        }
+        bounds.push_back(end);
+        begin = end;
+    }
+    return true;
+}
+
+// 在 data 和 scratch 之间逐趟两两归并相邻的有序段
+void mergeNaturalRuns(std::vector<int64_t> &data, std::vector<int64_t> &scratch, std::vector<size_t> bounds) {
+    scratch.resize(data.size());
+    int64_t *source = data.data();
+    int64_t *target = scratch.data();
+    std::vector<size_t> merged;
+    while (bounds.size() > 2) {
+        merged.assign(1, 0);
+        for (size_t k = 0; k + 1 < bounds.size(); k += 2) {
+            size_t begin = bounds[k];
+            size_t middle = bounds[k + 1];
+            size_t end = k + 2 < bounds.size() ? bounds[k + 2] : middle;
+            std::merge(source + begin, source + middle, source + middle, source + end, target + begin);
+            merged.push_back(end);
+        }
+        bounds.swap(merged);
+        std::swap(source, target);
+    }
+    if (source != data.data()) {
+        data.swap(scratch);
+    }
+}
+
+#ifdef SORT_KERNEL_X86
+
+// 比较交换层中取较大值的位置：第 i 个数与第 i ^ distance 个数比较，
+// 长度为 block 的子序列升序、降序交替（block 不小于寄存器宽度时全部升序）
+constexpr unsigned takesMaxMask(unsigned width, unsigned block, unsigned distance) {
+    unsigned mask = 0;
+    for (unsigned i = 0; i < width; ++i) {
+        if (((i & distance) != 0) != ((i & block) != 0)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+// 每个 64 位位置对应 _mm256_blend_epi32 掩码中的两位
+constexpr int expandToDwords(unsigned mask) {
+    int result = 0;
+    for (unsigned i = 0; i < 4; ++i) {
+        if (mask & (1u << i)) {
+            result |= 3 << (2 * i);
+        }
+    }
+    return result;
+}
+
+// AVX2 没有 64 位 min/max，用 cmpgt + blendv 实现
+struct Avx2Lanes {
+    using Vec = __m256i;
+    static constexpr size_t kWidth = 4;
+
+    __attribute__((target("avx2"))) static Vec load(const int64_t *p) {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+
+    __attribute__((target("avx2"))) static void store(int64_t *p, Vec v) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+    }
+
+    __attribute__((target("avx2"))) static void minMax(Vec a, Vec b, Vec &low, Vec &high) {
+        Vec greater = _mm256_cmpgt_epi64(a, b);
+        low = _mm256_blendv_epi8(a, b, greater);
+        high = _mm256_blendv_epi8(b, a, greater);
+    }
+
+    template<unsigned Block, unsigned Distance>
+    __attribute__((target("avx2"))) static Vec exchange(Vec v) {
+        Vec partner;
+        if constexpr (Distance == 1) {
+            partner = _mm256_shuffle_epi32(v, 0x4E);
+        } else {
+            partner = _mm256_permute4x64_epi64(v, 0x4E);
+        }
+        Vec low, high;
+        minMax(v, partner, low, high);
+        constexpr int kMaxLanes = expandToDwords(takesMaxMask(kWidth, Block, Distance));
+        return _mm256_blend_epi32(low, high, kMaxLanes);
+    }
+
+    // 寄存器内的双调排序
+    __attribute__((target("avx2"))) static void sortGroup(const int64_t *in, int64_t *out) {
+        Vec v = load(in);
+        v = exchange<2, 1>(v);
+        v = exchange<4, 2>(v);
+        v = exchange<4, 1>(v);
+        store(out, v);
+    }
+
+    // 两个升序寄存器的双调归并：low 得到较小的一半，high 得到较大的一半，都是升序
+    __attribute__((target("avx2"))) static void merge(Vec &low, Vec &high) {
+        Vec reversed = _mm256_permute4x64_epi64(high, 0x1B);
+        Vec a, b;
+        minMax(low, reversed, a, b);
+        low = exchange<4, 1>(exchange<4, 2>(a));
+        high = exchange<4, 1>(exchange<4, 2>(b));
+    }
+};
+
+struct Avx512Lanes {
+    using Vec = __m512i;
+    static constexpr size_t kWidth = 8;
+
+    __attribute__((target("avx512f"))) static Vec load(const int64_t *p) {
+        return _mm512_loadu_si512(p);
+    }
+
+    __attribute__((target("avx512f"))) static void store(int64_t *p, Vec v) {
+        _mm512_storeu_si512(p, v);
+    }
+
+    template<unsigned Block, unsigned Distance>
+    __attribute__((target("avx512f"))) static Vec exchange(Vec v) {
+        const Vec index = _mm512_set_epi64(7 ^ Distance, 6 ^ Distance, 5 ^ Distance, 4 ^ Distance,
+                                           3 ^ Distance, 2 ^ Distance, 1 ^ Distance, 0 ^ Distance);
+        Vec partner = _mm512_permutexvar_epi64(index, v);
+        Vec low = _mm512_min_epi64(v, partner);
+        Vec high = _mm512_max_epi64(v, partner);
+        return _mm512_mask_blend_epi64(static_cast<__mmask8>(takesMaxMask(kWidth, Block, Distance)), low, high);
+    }
+
+    __attribute__((target("avx512f"))) static void sortGroup(const int64_t *in, int64_t *out) {
+        Vec v = load(in);
+        v = exchange<2, 1>(v);
+        v = exchange<4, 2>(v);
+        v = exchange<4, 1>(v);
+        v = exchange<8, 4>(v);
+        v = exchange<8, 2>(v);
+        v = exchange<8, 1>(v);
+        store(out, v);
+    }
+
+    __attribute__((target("avx512f"))) static void merge(Vec &low, Vec &high) {
+        Vec reversed = _mm512_permutexvar_epi64(_mm512_set_epi64(0, 1, 2, 3, 4, 5, 6, 7), high);
+        Vec a = _mm512_min_epi64(low, reversed);
+        Vec b = _mm512_max_epi64(low, reversed);
+        low = exchange<8, 1>(exchange<8, 2>(exchange<8, 4>(a)));
+        high = exchange<8, 1>(exchange<8, 2>(exchange<8, 4>(b)));
+    }
+};
+
+// 下面的模板总是内联进带 target 属性的入口函数，向量不会按非 AVX 的调用约定传递
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// 归并两个长度为寄存器宽度倍数的有序数组：每次从下一组首元素较小的输入取一组，
+// 与上一次留下的较大的一组做双调归并，写出较小的一组
+template<typename Lanes>
+__attribute__((always_inline)) inline void mergeSortedGroups(const int64_t *a, size_t countA, const int64_t *b, size_t countB, int64_t *out) {
+    constexpr size_t kWidth = Lanes::kWidth;
+    const int64_t *endA = a + countA;
+    const int64_t *endB = b + countB;
+    typename Lanes::Vec low = Lanes::load(a);
+    typename Lanes::Vec high = Lanes::load(b);
+    a += kWidth;
+    b += kWidth;
+    Lanes::merge(low, high);
+    Lanes::store(out, low);
+    out += kWidth;
+
+    while (a != endA && b != endB) {
+        // 用条件传送选择输入，不产生难以预测的分支
+        bool takeA = *a < *b;
+        const int64_t *next = takeA ? a : b;
+        a += takeA ? kWidth : 0;
+        b += takeA ? 0 : kWidth;
+        low = Lanes::load(next);
+        Lanes::merge(low, high);
+        Lanes::store(out, low);
+        out += kWidth;
+    }
+    for (const int64_t *rest = a != endA ? a : b, *restEnd = a != endA ? endA : endB; rest != restEnd; rest += kWidth) {
+        low = Lanes::load(rest);
+        Lanes::merge(low, high);
+        Lanes::store(out, low);
+        out += kWidth;
+    }
+    Lanes::store(out, high);
+}
+
+// 一趟归并：把 source 中相邻的两个长度为 runLength 的有序段归并到 target
+template<typename Lanes>
+__attribute__((always_inline)) inline void mergePass(const int64_t *source, int64_t *target, size_t count, size_t runLength) {
+    for (size_t begin = 0; begin < count; begin += 2 * runLength) {
+        size_t middle = std::min(begin + runLength, count);
+        size_t end = std::min(begin + 2 * runLength, count);
+        if (middle == end) {
+            std::copy(source + begin, source + end, target + begin);
+        } else {
+            mergeSortedGroups<Lanes>(source + begin, middle - begin, source + middle, end - middle, target + begin);
+        }
+    }
+}
+
+// 归并 count 个数需要的趟数（从长度为 runLength 的有序段开始）
+inline unsigned mergePasses(size_t count, size_t runLength) {
+    unsigned passes = 0;
+    for (; runLength < count; runLength *= 2) {
+        ++passes;
+    }
+    return passes;
+}
+
+template<typename Lanes>
+__attribute__((always_inline)) inline void bitonicSortImpl(std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    constexpr size_t kWidth = Lanes::kWidth;
+    const size_t count = data.size();
+    const size_t vectorCount = count - count % kWidth;
+    scratch.resize(count);
+    int64_t *values = data.data();
+    int64_t *buffer = scratch.data();
+
+    // 逐块处理：寄存器内排序，再在块内逐趟归并，整个块留在 L1 中。
+    // 趟数为奇数时寄存器内排序的结果先写到辅助数组，保证块的结果落回 data
+    for (size_t begin = 0; begin < vectorCount; begin += kBitonicBlockValues) {
+        size_t blockCount = std::min(kBitonicBlockValues, vectorCount - begin);
+        int64_t *source = values + begin;
+        int64_t *target = buffer + begin;
+        if (mergePasses(blockCount, kWidth) % 2 != 0) {
+            std::swap(source, target);
+        }
+        for (size_t i = 0; i < blockCount; i += kWidth) {
+            Lanes::sortGroup(values + begin + i, source + i);
+        }
+        for (size_t runLength = kWidth; runLength < blockCount; runLength *= 2) {
+            mergePass<Lanes>(source, target, blockCount, runLength);
+            std::swap(source, target);
+        }
+    }
+
+    // 块之间逐趟归并，在数据和辅助数组之间来回
+    int64_t *source = values;
+    int64_t *target = buffer;
+    for (size_t runLength = kBitonicBlockValues; runLength < vectorCount; runLength *= 2) {
+        mergePass<Lanes>(source, target, vectorCount, runLength);
+        std::swap(source, target);
+    }
+
+    // 结果落在辅助数组上时带上尾部一起交换两个数组
+    if (source != values) {
+        std::copy(values + vectorCount, values + count, buffer + vectorCount);
+        data.swap(scratch);
+    }
+    mergeTail(data.data(), vectorCount, count);
+}
+
+#pragma GCC diagnostic pop
+
+__attribute__((target("avx2"))) void bitonicSortAvx2(std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    bitonicSortImpl<Avx2Lanes>(data, scratch);
+}
+
+__attribute__((target("avx512f"))) void bitonicSortAvx512(std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    bitonicSortImpl<Avx512Lanes>(data, scratch);
+}
+
+#endif
+
+bool cpuSupports(BitonicIsa isa) {
+#ifdef SORT_KERNEL_X86
+    switch (isa) {
+    case BitonicIsa::Avx512:
+        return __builtin_cpu_supports("avx512f");
+    case BitonicIsa::Avx2:
+        return __builtin_cpu_supports("avx2");
+    default:
+        return true;
+    }
+#else
+    return isa == BitonicIsa::Scalar;
+#endif
+}
+
+BitonicIsa detectBitonicIsa() {
+    if (cpuSupports(BitonicIsa::Avx512)) {
+        return BitonicIsa::Avx512;
+    }
+    if (cpuSupports(BitonicIsa::Avx2)) {
+        return BitonicIsa::Avx2;
+    }
+    return BitonicIsa::Scalar;
+}
+
+}
+
+const char *sortKernelName(SortKernel kernel) {
+    switch (kernel) {
+    case SortKernel::Radix:
+        return "radix";
+    case SortKernel::Bitonic:
+        switch (activeBitonicIsa()) {
+        case BitonicIsa::Avx512:
+            return "bitonic (avx512)";
+        case BitonicIsa::Avx2:
+            return "bitonic (avx2)";
+        default:
+            return "bitonic (std::sort fallback)";
+        }
+    default:
+        return "std::sort";
+    }
+}
+
+size_t radixHistogramBytes(RadixDigitBits digitBits) {
+    switch (digitBits) {
+    case RadixDigitBits::Bits8:
+        return radixHistogramBytes<8>();
+    case RadixDigitBits::Bits16:
+        return radixHistogramBytes<16>();
+    default:
+        return radixHistogramBytes<11>();
+    }
+}
+
+void radixSort(std::vector<int64_t> &data, std::vector<int64_t> &scratch, RadixDigitBits digitBits) {
+    if (data.size() < kRadixMinSize) {
+        std::sort(data.begin(), data.end());
+        return;
+    }
+    switch (digitBits) {
+    case RadixDigitBits::Bits8:
+        radixSortImpl<8>(data, scratch);
+        break;
+    case RadixDigitBits::Bits16:
+        radixSortImpl<16>(data, scratch);
+        break;
+    default:
+        radixSortImpl<11>(data, scratch);
+        break;
+    }
+}
+
+BitonicIsa activeBitonicIsa() {
+    static const BitonicIsa isa = detectBitonicIsa();
+    return isa;
+}
+
+const char *bitonicIsaName(BitonicIsa isa) {
+    switch (isa) {
+    case BitonicIsa::Avx512:
+        return "avx512";
+    case BitonicIsa::Avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+void bitonicSort(BitonicIsa isa, std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    if (!cpuSupports(isa)) {
+        isa = BitonicIsa::Scalar;
+    }
+#ifdef SORT_KERNEL_X86
+    if (data.size() >= kBitonicMinSize) {
+        if (isa == BitonicIsa::Avx512) {
+            bitonicSortAvx512(data, scratch);
+            return;
+        }
+        if (isa == BitonicIsa::Avx2) {
+            bitonicSortAvx2(data, scratch);
+            return;
+        }
+    }
+#endif
+    std::sort(data.begin(), data.end());
+}
+
+void bitonicSort(std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+    bitonicSort(activeBitonicIsa(), data, scratch);
+}
+
+void sortValues(std::vector<int64_t> &data, std::vector<int64_t> &scratch, SortKernel kernel) {
+    switch (kernel) {
+    case SortKernel::Radix:
+        radixSort(data, scratch);
+        break;
+    case SortKernel::Bitonic:
+        bitonicSort(data, scratch);
+        break;
+    default:
+        std::sort(data.begin(), data.end());
+        break;
+    }
+}
+
+Presortedness sortValuesAdaptive(std::vector<int64_t> &data, std::vector<int64_t> &scratch, SortKernel kernel) {
+    Presortedness result{0, 0};
+    std::vector<size_t> bounds;
+    if (!findNaturalRuns(data, bounds, result.reversedRuns)) {
+        sortValues(data, scratch, kernel);
+        return result;
+    }
+    result.naturalRuns = bounds.size() - 1;
+    if (result.naturalRuns > 1) {
+        if (scratch.capacity() >= data.size()) {
+            mergeNaturalRuns(data, scratch, std::move(bounds));
+        } else {
+            sortValues(data, scratch, kernel);
+        }
+    }
+    return result;
+}
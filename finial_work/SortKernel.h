@@ -0,0 +1,66 @@
+#ifndef SORTKERNEL_H
+#define SORTKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 生成有序文件时使用的内存排序算法
+enum class SortKernel {
+    StdSort,  // std::sort，比较排序
+    Radix,    // LSD 基数排序
+    Bitonic   // SIMD 双调排序网络 + 向量化归并
+};
+
+const char *sortKernelName(SortKernel kernel);
+
+// LSD 基数排序每趟处理的位数
+enum class RadixDigitBits {
+    Bits8 = 8,    // 8 趟，直方图 256 项
+    Bits11 = 11,  // 6 趟，直方图 2048 项，能放进 L1
+    Bits16 = 16   // 4 趟，直方图 65536 项
+};
+
+// 对有符号 64 位整数做 LSD 基数排序：翻转符号位后按无符号数排序。
+// 所有趟的直方图在一次扫描中统计，某一位在所有数上都相同的趟直接跳过。
+// scratch 用作辅助数组（会被调整到 data 的大小），排序结束时两者可能互换，调用方应同时保留二者以便复用
+void radixSort(std::vector<int64_t> &data, std::vector<int64_t> &scratch, RadixDigitBits digitBits = RadixDigitBits::Bits11);
+
+// 基数排序的直方图每个线程按位宽各分配一次，之后一直保留复用；返回一个线程为 digitBits 保留的字节数，
+// 调用方据此把它计入内存预算（sortValues 使用默认的位宽）
+size_t radixHistogramBytes(RadixDigitBits digitBits = RadixDigitBits::Bits11);
+
+// 双调排序使用的指令集，运行时按 CPU 支持情况选择
+enum class BitonicIsa {
+    Scalar,  // 不支持 AVX2 时退回 std::sort
+    Avx2,    // 一个寄存器 4 个数
+    Avx512   // 一个寄存器 8 个数
+};
+
+BitonicIsa activeBitonicIsa();
+const char *bitonicIsaName(BitonicIsa isa);
+
+// 无分支的向量化排序：先在寄存器内用双调排序网络排好每组数，
+// 再在 L1 大小的块内逐趟两两归并，最后对整个数组逐趟归并，归并的比较交换也由排序网络完成。
+// scratch 的用法与 radixSort 相同。指定的指令集 CPU 不支持时退回 std::sort
+void bitonicSort(std::vector<int64_t> &data, std::vector<int64_t> &scratch);
+void bitonicSort(BitonicIsa isa, std::vector<int64_t> &data, std::vector<int64_t> &scratch);
+
+// 按 kernel 排序；StdSort 不使用 scratch
+void sortValues(std::vector<int64_t> &data, std::vector<int64_t> &scratch, SortKernel kernel);
+
+// 自然有序段不超过这个数时直接归并，不再排序
+constexpr size_t kMaxNaturalRuns = 8;
+
+// 预扫描看到的输入有序程度
+struct Presortedness {
+    size_t naturalRuns;   // 自然有序段（非降序段或降序段）的个数；超过 kMaxNaturalRuns 或没有数据时为 0
+    size_t reversedRuns;  // 其中被就地反转的降序段个数
+};
+
+// 先一次扫描找出自然有序段（类似 timsort，降序段就地反转）：只有一段时不再排序，
+// 段数不超过 kMaxNaturalRuns 且 scratch 的容量足够时用 scratch 逐趟两两归并，否则按 kernel 排序。
+// 无序数据扫描到第 kMaxNaturalRuns + 1 段就停止，额外开销很小。scratch 的用法与 radixSort 相同
+Presortedness sortValuesAdaptive(std::vector<int64_t> &data, std::vector<int64_t> &scratch, SortKernel kernel);
+
+#endif // SORTKERNEL_H
@@ -1,55 +1,45 @@
-#include <fstream>
-#include <queue>
+#include "SortMerge.h"
+#include "LoserTree.h"
+#include <cstdio>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
-#include <iostream>
-#include <limits>
+#include <stdexcept>
 
-void mergeFiles(const std::vector<std::string> &inputFiles, const std::string &outputFile) {
-    std::ofstream outFile(outputFile);
-    if (!outFile.is_open()) {
-        std::cerr << "Error opening output file: " << outputFile << std::endl;
-        return;
-    }
+namespace {
 
-    std::vector<std::ifstream> streams;
-    for (const auto &file : inputFiles) {
-        streams.emplace_back(file);
-        if (!streams.back().is_open()) {
-            std::cerr << "Error opening input file: " << file << std::endl;
-            return;
-        }
+template<typename Writer>
+void mergeInto(std::vector<std::unique_ptr<RunReader>> &readers, Writer &writer) {
+    std::vector<RunReader *> inputs;
+    for (auto &reader : readers) {
+        inputs.push_back(reader.get());
     }
+    LoserTree tree(inputs);
+    while (tree.writeNext(writer, SIZE_MAX) > 0) {
+    }
+}
 
-    struct FileEntry {
-        int64_t value;
-        size_t index;
-    };
-
-    auto compare = [](const FileEntry &a, const FileEntry &b) {
-        return a.value > b.value;
-    };
-
-    std::priority_queue<FileEntry, std::vector<FileEntry>, decltype(compare)> minHeap(compare);
+}
 
-    for (size_t i = 0; i < streams.size(); ++i) {
-        int64_t value;
-        if (streams[i] >> value) {
-            minHeap.push({value, i});
-        }
+void mergeFiles(const std::vector<std::string> &inputFiles, const std::string &outputFile, OutputFormat format, size_t bufferBytes) {
+    std::vector<std::unique_ptr<RunReader>> readers;
+    for (const auto &file : inputFiles) {
+        readers.push_back(std::make_unique<RunReader>(file, bufferBytes));
     }
 
-    while (!minHeap.empty()) {
-        auto [val, index] = minHeap.top();
-        minHeap.pop();
-        outFile << val << "\n";  // 将排序后的数据写入输出文件
-        std::cout << "Writing value: " << val << " from stream " << index << " to output file." << std::endl;
-
-        int64_t value;
-        if (streams[index] >> value) {
-            minHeap.push({value, index});
+    if (format == OutputFormat::BinaryRun) {
+        RunWriter writer(outputFile, bufferBytes);
+        mergeInto(readers, writer);
+        writer.close();
+    } else {
+        try {
+            TextWriter writer(outputFile, bufferBytes);
+            mergeInto(readers, writer);
+            writer.close();
+        } catch (...) {
+            std::remove(outputFile.c_str());
+            throw;
         }
     }
-
-    outFile.close();
 }
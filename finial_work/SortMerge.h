@@ -3,7 +3,11 @@
 
 #include <vector>
 #include <string>
+#include "RunFormat.h"
 
-void mergeFiles(const std::vector<std::string> &filePaths, const std::string &outputPath);
+// 用败者树把若干个 run 多路合并到 outputPath，format 决定输出 run 还是文本。
+// 每个输入和输出各用 bufferBytes 字节的缓冲区。打开或读写文件失败时抛出 std::runtime_error
+void mergeFiles(const std::vector<std::string> &filePaths, const std::string &outputPath, OutputFormat format = OutputFormat::Text,
+                size_t bufferBytes = kRunBufferBytes);
 
 #endif // SORTMERGE_H
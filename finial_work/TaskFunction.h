@@ -0,0 +1,108 @@
+#ifndef TASKFUNCTION_H
+#define TASKFUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// 只可移动的 void() 可调用对象，替代线程池中的 std::function<void()>。
+// 不超过 kInlineSize 字节的可调用对象直接放在对象内部的缓冲区里，提交任务时不分配堆内存；
+// 更大的对象才退化为堆上分配。允许保存 std::packaged_task 等不可复制的类型。
+class TaskFunction {
+public:
+    static constexpr size_t kInlineSize = 64;
+
+    TaskFunction() noexcept : ops(nullptr) {}
+    TaskFunction(std::nullptr_t) noexcept : ops(nullptr) {}
+
+    template<typename F, typename Fn = std::decay_t<F>,
+             typename = std::enable_if_t<!std::is_same<Fn, TaskFunction>::value>>
+    TaskFunction(F &&f) : ops(nullptr) {
+        if constexpr (storedInline<Fn>()) {
+            new (storage) Fn(std::forward<F>(f));
+        } else {
+            new (storage) Fn *(new Fn(std::forward<F>(f)));
+        }
+        ops = &opsFor<Fn>();
+    }
+
+    TaskFunction(TaskFunction &&other) noexcept : ops(other.ops) {
+        if (ops) {
+            ops->move(storage, other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    TaskFunction &operator=(TaskFunction &&other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops) {
+                other.ops->move(storage, other.storage);
+                ops = other.ops;
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    TaskFunction &operator=(std::nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    TaskFunction(const TaskFunction &) = delete;
+    TaskFunction &operator=(const TaskFunction &) = delete;
+
+    ~TaskFunction() { reset(); }
+
+    explicit operator bool() const noexcept { return ops != nullptr; }
+
+    void operator()() { ops->invoke(storage); }
+
+private:
+    // 每种可调用类型一张操作表，代替虚函数
+    struct Ops {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src) noexcept;  // 移动到 dst 并销毁 src
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template<typename Fn>
+    static constexpr bool storedInline() {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template<typename Fn>
+    static const Ops &opsFor() {
+        if constexpr (storedInline<Fn>()) {
+            static const Ops table{
+                [](void *s) { (*static_cast<Fn *>(s))(); },
+                [](void *dst, void *src) noexcept {
+                    new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+                    static_cast<Fn *>(src)->~Fn();
+                },
+                [](void *s) noexcept { static_cast<Fn *>(s)->~Fn(); }};
+            return table;
+        } else {
+            static const Ops table{
+                [](void *s) { (**static_cast<Fn **>(s))(); },
+                [](void *dst, void *src) noexcept { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); },
+                [](void *s) noexcept { delete *static_cast<Fn **>(s); }};
+            return table;
+        }
+    }
+
+    void reset() noexcept {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage[kInlineSize];
+    const Ops *ops;
+};
+
+#endif // TASKFUNCTION_H
@@ -0,0 +1,163 @@
+#include "TaskGraph.h"
+
+namespace {
+
+void runNode(const TaskHandle &node);
+
+void scheduleNode(const TaskHandle &node) {
+    node->group->schedule([node] { runNode(node); }, node->priority);
+}
+
+// 前驱完成时调用，计数降为 0 的调用者负责提交节点
+void releaseNode(const TaskHandle &node) {
+    if (node->remaining.fetch_sub(1) == 1) {
+        scheduleNode(node);
+    }
+}
+
+// 记录第一个异常并取消整个组，其余任务尽快停止
+void recordError(TaskGroupState &group, std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (!group.error) {
+        group.error = error;
+    }
+    group.cancellation.cancel();
+}
+
+// 节点的工作（同步函数或协程）结束后调用：释放后继节点并更新组计数
+void completeNode(const TaskHandle &node) {
+    TaskGroupState &group = *node->group;
+    node->work = nullptr;  // 尽早释放捕获的数据
+    node->asyncWork = nullptr;
+
+    std::vector<TaskHandle> successors;
+    {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->finished = true;
+        successors.swap(node->successors);
+    }
+    for (const auto &successor : successors) {
+        releaseNode(successor);
+    }
+
+    // 每个节点完成都通知，waitFor 等的是某一个节点
+    std::lock_guard<std::mutex> lock(group.mutex);
+    --group.outstanding;
+    group.done.notify_all();
+}
+
+void runNode(const TaskHandle &node) {
+    TaskGroupState &group = *node->group;
+    if (group.cancellation.isCancelled()) {
+        completeNode(node);
+        return;
+    }
+
+    if (node->asyncWork) {
+        // 协程节点：协程可能在 I/O 处挂起，真正结束时才算完成
+        Task<void> task;
+        try {
+            task = node->asyncWork();
+        } catch (...) {
+            recordError(group, std::current_exception());
+            completeNode(node);
+            return;
+        }
+        startDetached(std::move(task), [node](std::exception_ptr error) {
+            if (error) {
+                recordError(*node->group, error);
+            }
+            completeNode(node);
+        });
+        return;
+    }
+
+    try {
+        node->work();
+    } catch (...) {
+        recordError(group, std::current_exception());
+    }
+    completeNode(node);
+}
+
+}
+
+TaskGroup::~TaskGroup() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [this] { return state->outstanding == 0; });
+}
+
+TaskHandle TaskGroup::spawn(TaskFunction work, TaskPriority priority) {
+    return whenAll({}, std::move(work), priority);
+}
+
+TaskHandle TaskGroup::then(const TaskHandle &before, TaskFunction work, TaskPriority priority) {
+    return whenAll({before}, std::move(work), priority);
+}
+
+TaskHandle TaskGroup::spawnAsync(std::function<Task<void>()> work, TaskPriority priority) {
+    return whenAllAsync({}, std::move(work), priority);
+}
+
+TaskHandle TaskGroup::whenAllAsync(const std::vector<TaskHandle> &deps, std::function<Task<void>()> work, TaskPriority priority) {
+    auto node = std::make_shared<TaskNode>();
+    node->asyncWork = std::move(work);
+    return addNode(node, deps, priority);
+}
+
+TaskHandle TaskGroup::whenAll(const std::vector<TaskHandle> &deps, TaskFunction work, TaskPriority priority) {
+    auto node = std::make_shared<TaskNode>();
+    node->work = std::move(work);
+    return addNode(node, deps, priority);
+}
+
+TaskHandle TaskGroup::addNode(const TaskHandle &node, const std::vector<TaskHandle> &deps, TaskPriority priority) {
+    node->group = state;
+    node->priority = priority;
+    node->remaining.store(1);  // 构建保护，防止依赖尚未登记完就被提交
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        ++state->outstanding;
+    }
+
+    for (const auto &dep : deps) {
+        std::lock_guard<std::mutex> lock(dep->mutex);
+        if (!dep->finished) {
+            node->remaining.fetch_add(1);
+            dep->successors.push_back(node);
+        }
+    }
+
+    releaseNode(node);
+    return node;
+}
+
+void TaskGroup::cancel() {
+    state->cancellation.cancel();
+}
+
+bool TaskGroup::isCancelled() const {
+    return state->cancellation.isCancelled();
+}
+
+CancellationToken TaskGroup::token() const {
+    return state->cancellation.token();
+}
+
+void TaskGroup::waitFor(const TaskHandle &node) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [&node] {
+        std::lock_guard<std::mutex> nodeLock(node->mutex);
+        return node->finished;
+    });
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [this] { return state->outstanding == 0; });
+    if (state->error) {
+        std::exception_ptr error = state->error;
+        state->error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Cancellation.h"
+#include "Coroutine.h"
+#include "TaskFunction.h"
+#include "ThreadPool.h"
+
+// 任务依赖图：每个节点记录尚未完成的前驱个数，计数降为 0 的那一刻才提交到线程池，
+// 因此合并任务恰好在它的输入全部就绪时开始执行，既不需要轮询，也不需要共享容器。
+// 一个 TaskGroup 就是一个作业：任一任务抛出异常即取消整个组，尚未开始的任务直接跳过，
+// 执行中的任务通过 token() 协作检查取消。
+
+struct TaskGroupState;
+
+struct TaskNode {
+    TaskFunction work;
+    std::function<Task<void>()> asyncWork;  // 协程节点：返回要执行的协程，结束时节点才算完成
+    std::shared_ptr<TaskGroupState> group;
+    TaskPriority priority;
+    std::atomic<size_t> remaining;  // 未完成的前驱数（构建期间额外持有 1）
+    std::mutex mutex;               // 保护 finished 和 successors
+    bool finished = false;
+    std::vector<std::shared_ptr<TaskNode>> successors;
+};
+
+using TaskHandle = std::shared_ptr<TaskNode>;
+
+// 一组任务共享的状态：提交方式、取消标志、未完成节点数以及第一个异常
+struct TaskGroupState {
+    std::function<void(TaskFunction, TaskPriority)> schedule;
+    CancellationSource cancellation;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t outstanding = 0;
+    std::exception_ptr error;
+};
+
+class TaskGroup {
+public:
+    template<typename Pool>
+    explicit TaskGroup(Pool &pool) : state(std::make_shared<TaskGroupState>()) {
+        state->schedule = [&pool](TaskFunction task, TaskPriority priority) { pool.submit(std::move(task), priority); };
+    }
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    // 无依赖的任务，立即提交
+    TaskHandle spawn(TaskFunction work, TaskPriority priority = TaskPriority::RunGeneration);
+
+    // before 完成后执行 work
+    TaskHandle then(const TaskHandle &before, TaskFunction work, TaskPriority priority = TaskPriority::RunGeneration);
+
+    // deps 全部完成后执行 work；deps 可以属于其他 TaskGroup
+    TaskHandle whenAll(const std::vector<TaskHandle> &deps, TaskFunction work, TaskPriority priority = TaskPriority::RunGeneration);
+
+    // 协程版本：work 返回的协程结束（而不是 work 返回）时，后继节点才会被释放。
+    // 协程可以在 I/O 处挂起，不占用工作线程
+    TaskHandle spawnAsync(std::function<Task<void>()> work, TaskPriority priority = TaskPriority::RunGeneration);
+    TaskHandle whenAllAsync(const std::vector<TaskHandle> &deps, std::function<Task<void>()> work, TaskPriority priority = TaskPriority::RunGeneration);
+
+    // 等待组内所有任务完成（或因取消被跳过）；若有任务抛出异常，重新抛出第一个
+    void wait();
+
+    // 等待 node 完成（或因取消被跳过），不重新抛出异常；用来限制提交方领先执行的距离
+    void waitFor(const TaskHandle &node);
+
+    // 取消整个组：尚未开始的任务不再执行
+    void cancel();
+    bool isCancelled() const;
+
+    // 交给任务内部使用的取消令牌
+    CancellationToken token() const;
+
+private:
+    std::shared_ptr<TaskGroupState> state;
+
+    TaskHandle addNode(const TaskHandle &node, const std::vector<TaskHandle> &deps, TaskPriority priority);
+};
+
+#endif // TASKGRAPH_H
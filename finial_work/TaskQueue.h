@@ -0,0 +1,74 @@
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include "TaskFunction.h"
+
+// 队列中的任务及其入队时间（纳秒，用于统计排队延迟；未开启统计时为 0）
+struct QueuedTask {
+    TaskFunction function;
+    uint64_t enqueueTime = 0;
+};
+
+// 线程池全局任务队列的两种实现，作为 BasicThreadPool 的模板策略参数。
+// 两者接口一致：push 在队列已满时返回 false 且不移动 task；pop 在队列为空时返回 false。
+// kBounded 表示队列本身有容量上限，线程池据此保证提交数不超过容量。
+
+// 粗粒度锁队列：一把互斥锁保护 std::queue，容量不限
+class LockedTaskQueue {
+public:
+    static constexpr bool kBounded = false;
+
+    explicit LockedTaskQueue(size_t /*capacity*/) {}
+
+    bool push(QueuedTask &task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+        return true;
+    }
+
+    bool pop(QueuedTask &task) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (tasks.empty()) {
+            return false;
+        }
+        task = std::move(tasks.front());
+        tasks.pop();
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::queue<QueuedTask> tasks;
+};
+
+// 无锁有界环形队列（多生产者多消费者）。
+// 每个槽位带一个序号：序号等于入队位置时可写，等于入队位置 + 1 时可读，
+// 生产者和消费者分别通过 CAS 推进各自的位置，不需要任何锁。
+class LockFreeTaskQueue {
+public:
+    static constexpr bool kBounded = true;
+
+    explicit LockFreeTaskQueue(size_t capacity);
+
+    bool push(QueuedTask &task);
+    bool pop(QueuedTask &task);
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        QueuedTask task;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+#endif // TASKQUEUE_H
@@ -1,66 +1,528 @@
 #include "ThreadPool.h"
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-ThreadPool::ThreadPool(size_t threads) : stop(false) {
+namespace {
+// 当前线程所属的线程池及其编号，用于识别工作线程内部提交的任务
+thread_local const void *currentPool = nullptr;
+thread_local size_t currentIndex = 0;
+
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex word must be a plain int");
+
+void futexWait(std::atomic<int> *word, int expected) {
+    syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void futexWake(std::atomic<int> *word) {
+    syscall(SYS_futex, reinterpret_cast<int *>(word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 只由一个线程写入的计数器，普通读改写即可
+void bump(std::atomic<uint64_t> &counter, uint64_t delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+size_t latencyBucket(uint64_t ns) {
+    size_t bucket = 0;
+    while (ns != 0 && bucket + 1 < kLatencyBuckets) {
+        ns >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+}
+
+template<typename QueuePolicy>
+BasicThreadPool<QueuePolicy>::BasicThreadPool(size_t threads, SchedulingMode mode, size_t queueCapacity,
+                                              const ThreadPoolOptions &options)
+    : stop(false), mode(mode), pendingTasks(0), idleWorkers(0), spinningWorkers(0),
+      spinIterations(options.spinIterations), yieldIterations(options.yieldIterations),
+      parks(0), wakeupsIssued(0), wakeupsAvoided(0),
+      collectStats(options.collectStats), dumpStatsOnShutdown(options.dumpStatsOnShutdown), maxQueueDepth(0),
+      activeTasks(0),
+      capacity(queueCapacity), queuedTasks(0), waitingProducers(0) {
+    if (QueuePolicy::kBounded && capacity == 0) {
+        capacity = kDefaultQueueCapacity;
+    }
+    // 每条优先级队列都按总容量分配，占用数受 capacity 限制，因此 push 不会因队列满而失败
+    for (size_t p = 0; p < kPriorityLevels; ++p) {
+        tasks.emplace_back(std::make_unique<QueuePolicy>(capacity));
+    }
     for (size_t i = 0; i < threads; ++i) {
-        workers.emplace_back([this, i] { 
+        parkSlots.emplace_back(std::make_unique<ParkSlot>());
+        counters.emplace_back(std::make_unique<WorkerCounters>());
+    }
+    if (options.pinWorkers) {
+        workerCpus = assignWorkerCpus(readCpuTopology(), threads);
+    }
+
+    if (mode == SchedulingMode::WorkStealing) {
+        for (size_t i = 0; i < threads; ++i) {
+            localQueues.emplace_back(std::make_unique<WorkerQueue>());
+        }
+
+        // 窃取顺序：从相邻线程开始轮转；已绑定 CPU 时同一 NUMA 节点的线程排在最前，其次是同一插槽的
+        for (size_t i = 0; i < threads; ++i) {
+            std::vector<size_t> order;
+            for (size_t offset = 1; offset < threads; ++offset) {
+                order.push_back((i + offset) % threads);
+            }
+            if (!workerCpus.empty()) {
+                int package = workerCpus[i].package;
+                int node = workerCpus[i].node;
+                std::stable_partition(order.begin(), order.end(), [this, package](size_t victim) {
+                    return workerCpus[victim].package == package;
+                });
+                std::stable_partition(order.begin(), order.end(), [this, node](size_t victim) {
+                    return workerCpus[victim].node == node;
+                });
+            }
+            victimOrder.push_back(std::move(order));
+        }
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i] {
+            if (i < workerCpus.size() && !pinCurrentThread(workerCpus[i].cpu)) {
+                std::cerr << "Failed to pin worker thread " << i << " to cpu " << workerCpus[i].cpu << std::endl;
+            }
             std::cout << "Worker thread " << i << " started." << std::endl;
-            workerThread(); 
+            workerThread(i);
             std::cout << "Worker thread " << i << " finished." << std::endl;
         });
     }
 }
 
-ThreadPool::~ThreadPool() {
+template<typename QueuePolicy>
+BasicThreadPool<QueuePolicy>::~BasicThreadPool() {
     stop.store(true);
-    condition.notify_all();
     joinAll(); // Ensure all threads are joined on destruction.
 }
 
-void ThreadPool::workerThread() {
-    while (true) {
-        std::function<void()> task;
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            condition.wait(lock, [this] {
-                return stop.load() || !tasks.empty();
-            });
+template<typename QueuePolicy>
+bool BasicThreadPool<QueuePolicy>::isWorkerThread() const {
+    return currentPool == this;
+}
 
-            if (stop.load() && tasks.empty()) {
-                // std::cout << "Stopping worker thread " << std::this_thread::get_id() << std::endl;
+template<typename QueuePolicy>
+size_t BasicThreadPool<QueuePolicy>::currentWorkerIndex() const {
+    return isWorkerThread() ? currentIndex : threadCount();
+}
+
+template<typename QueuePolicy>
+bool BasicThreadPool<QueuePolicy>::tryReserveSlot() {
+    if (capacity == 0) {
+        return true;
+    }
+    size_t queued = queuedTasks.load();
+    while (queued < capacity) {
+        if (queuedTasks.compare_exchange_weak(queued, queued + 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::releaseSlot() {
+    if (capacity == 0) {
+        return;
+    }
+    queuedTasks.fetch_sub(1);
+    if (waitingProducers.load() > 0) {
+        std::lock_guard<std::mutex> lock(spaceMutex);
+        spaceCondition.notify_one();
+    }
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::pushTask(TaskFunction function, TaskPriority priority, bool slotReserved) {
+    size_t lane = static_cast<size_t>(priority);
+    QueuedTask task{std::move(function), collectStats ? nowNs() : 0};
+    bool fromWorker = isWorkerThread();
+    activeTasks.fetch_add(1);
+    if (mode == SchedulingMode::WorkStealing && fromWorker) {
+        // 工作线程派生的任务放入自己的本地队列，不经过全局队列，也不受容量限制
+        WorkerQueue &local = *localQueues[currentIndex];
+        std::lock_guard<std::mutex> lock(local.mutex);
+        local.tasks[lane].push_back(std::move(task));
+    } else {
+        if (!slotReserved && !tryReserveSlot()) {
+            if (fromWorker) {
+                // 队列已满且提交者就是工作线程：就地执行，避免所有线程互相等待
+                invokeTask(task.function);
+                finishTask();
                 return;
             }
 
-            if (!tasks.empty()) {
-                task = std::move(tasks.front());
-                tasks.pop();
+            // 外部线程在队列满时阻塞，直到工作线程取走任务腾出空间
+            std::unique_lock<std::mutex> lock(spaceMutex);
+            waitingProducers.fetch_add(1);
+            spaceCondition.wait(lock, [this, &slotReserved] {
+                if (stop.load()) {
+                    return true;
+                }
+                slotReserved = tryReserveSlot();
+                return slotReserved;
+            });
+            waitingProducers.fetch_sub(1);
+        }
+
+        if (stop) {
+            if (slotReserved) {
+                releaseSlot();
+            }
+            finishTask();
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+        }
+
+        while (!tasks[lane]->push(task)) {
+            std::this_thread::yield();
+        }
+    }
+
+    // 先发布任务再计数，再决定是否需要唤醒
+    long pending = pendingTasks.fetch_add(1) + 1;
+    if (collectStats) {
+        long observed = maxQueueDepth.load(std::memory_order_relaxed);
+        while (pending > observed && !maxQueueDepth.compare_exchange_weak(observed, pending, std::memory_order_relaxed)) {
+        }
+    }
+    wakeWorker();
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::wakeWorker() {
+    // 自旋中的线程足以取走所有待处理任务时，不必发起系统调用
+    size_t spinning = spinningWorkers.load();
+    if (spinning > 0 && static_cast<long>(spinning) >= pendingTasks.load()) {
+        wakeupsAvoided.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (idleWorkers.load() == 0) {
+        return;
+    }
+
+    size_t target;
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        if (parkedWorkers.empty()) {
+            return;
+        }
+        target = parkedWorkers.back();
+        parkedWorkers.pop_back();
+        idleWorkers.fetch_sub(1);
+    }
+    parkSlots[target]->state.store(0);
+    futexWake(&parkSlots[target]->state);
+    wakeupsIssued.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename QueuePolicy>
+bool BasicThreadPool<QueuePolicy>::popTask(size_t index, QueuedTask &task) {
+    // 从最高优先级开始，每个优先级依次尝试：本地队列、全局队列、窃取
+    for (size_t lane = kPriorityLevels; lane-- > 0;) {
+        if (mode == SchedulingMode::WorkStealing) {
+            WorkerQueue &local = *localQueues[index];
+            std::lock_guard<std::mutex> lock(local.mutex);
+            if (!local.tasks[lane].empty()) {
+                task = std::move(local.tasks[lane].back());
+                local.tasks[lane].pop_back();
+                pendingTasks.fetch_sub(1);
+                return true;
+            }
+        }
+
+        if (tasks[lane]->pop(task)) {
+            pendingTasks.fetch_sub(1);
+            releaseSlot();
+            return true;
+        }
+
+        if (mode == SchedulingMode::WorkStealing) {
+            // 从其他线程队列头部窃取最早提交的任务，同一插槽的线程优先
+            for (size_t victimIndex : victimOrder[index]) {
+                WorkerQueue &victim = *localQueues[victimIndex];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks[lane].empty()) {
+                    task = std::move(victim.tasks[lane].front());
+                    victim.tasks[lane].pop_front();
+                    pendingTasks.fetch_sub(1);
+                    bump(counters[index]->steals);
+                    return true;
+                }
             }
         }
+    }
+    return false;
+}
 
-        if (task) {
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::finishTask() {
+    if (activeTasks.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idleCondition.notify_all();
+    }
+}
+
+template<typename QueuePolicy>
+bool BasicThreadPool<QueuePolicy>::spinForTask(size_t index, QueuedTask &task) {
+    size_t rounds = spinIterations + yieldIterations;
+    if (rounds == 0) {
+        return false;
+    }
+
+    spinningWorkers.fetch_add(1);
+    bool found = false;
+    for (size_t i = 0; i < rounds && !stop.load(); ++i) {
+        if (pendingTasks.load() > 0 && popTask(index, task)) {
+            found = true;
+            break;
+        }
+        if (i < spinIterations) {
+            cpuRelax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    spinningWorkers.fetch_sub(1);
+    return found;
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::parkWorker(size_t index) {
+    std::atomic<int> &state = parkSlots[index]->state;
+    {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        state.store(1);
+        parkedWorkers.push_back(index);
+        idleWorkers.fetch_add(1);
+    }
+
+    // 登记之后再检查一次，避免与提交者错过彼此（提交者先计数再检查 idleWorkers）
+    if (stop.load() || pendingTasks.load() > 0) {
+        std::lock_guard<std::mutex> lock(parkMutex);
+        auto it = std::find(parkedWorkers.begin(), parkedWorkers.end(), index);
+        if (it != parkedWorkers.end()) {
+            parkedWorkers.erase(it);
+            idleWorkers.fetch_sub(1);
+            state.store(0);
+        }
+        // 否则唤醒者已经把本线程移出列表，state 马上会被置 0
+    }
+
+    if (state.load() == 1) {
+        parks.fetch_add(1, std::memory_order_relaxed);
+    }
+    while (state.load() == 1) {
+        futexWait(&state, 1);
+    }
+}
+
+// 执行任务；逃出任务的异常记录下来交给 waitIdle，不让它传到工作线程的线程函数里调用 std::terminate
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::invokeTask(TaskFunction &function) noexcept {
+    try {
+        function();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!taskError) {
+            taskError = std::current_exception();
+        }
+    }
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::runTask(size_t index, QueuedTask &task) {
+    if (!collectStats) {
+        invokeTask(task.function);
+        return;
+    }
+
+    // lastFinish 记录本线程上一个任务结束的时间，两次任务之间的间隔计为空闲
+    thread_local uint64_t lastFinish = 0;
+    WorkerCounters &counter = *counters[index];
+    uint64_t start = nowNs();
+    if (lastFinish != 0) {
+        bump(counter.idleNs, start - lastFinish);
+    }
+    bump(counter.queueWait[latencyBucket(start > task.enqueueTime ? start - task.enqueueTime : 0)]);
+
+    invokeTask(task.function);
+
+    lastFinish = nowNs();
+    bump(counter.busyNs, lastFinish - start);
+    bump(counter.tasksExecuted);
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::workerThread(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+
+    while (true) {
+        QueuedTask task;
+        if (popTask(index, task) || spinForTask(index, task)) {
             // std::cout << "Executing task by thread " << std::this_thread::get_id() << std::endl;
-            task();
+            runTask(index, task);
             // std::cout << "Task completed by thread " << std::this_thread::get_id() << std::endl;
+            finishTask();
+            continue;
         }
+
+        if (stop.load() && pendingTasks.load() <= 0) {
+            // std::cout << "Stopping worker thread " << std::this_thread::get_id() << std::endl;
+            return;
+        }
+
+        parkWorker(index);
     }
 }
 
 
 
-void ThreadPool::joinAll() {
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::waitIdle() {
+    if (currentPool == this) {
+        throw std::logic_error("waitIdle called from a worker of the same ThreadPool");
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCondition.wait(lock, [this] {
+            return activeTasks.load() == 0;
+        });
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        error = std::exchange(taskError, nullptr);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+template<typename QueuePolicy>
+void BasicThreadPool<QueuePolicy>::joinAll() {
+    stop.store(true);
+    {
+        // 唤醒所有休眠线程，让它们处理剩余的任务后退出
+        std::lock_guard<std::mutex> lock(parkMutex);
+        for (size_t index : parkedWorkers) {
+            parkSlots[index]->state.store(0);
+            futexWake(&parkSlots[index]->state);
+        }
+        parkedWorkers.clear();
+        idleWorkers.store(0);
+    }
     {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        stop.store(true);
+        std::lock_guard<std::mutex> lock(spaceMutex);
+        spaceCondition.notify_all();  // 唤醒因队列满而阻塞的提交者
     }
-    condition.notify_all();  // 通知所有线程停止并处理剩余的任务
     std::cout << "Joining all threads." << std::endl;
-    
+    bool wasRunning = false;
+
     for (size_t i = 0; i < workers.size(); ++i) {
         if (workers[i].joinable()) {
             std::cout << "Joining worker thread " << i << "." << std::endl;
             workers[i].join();
+            wasRunning = true;
             std::cout << "Worker thread " << i << " joined." << std::endl;
         }
     }
     std::cout << "All threads joined." << std::endl;
+
+    if (dumpStatsOnShutdown && wasRunning) {
+        stats().print(std::cout);
+    }
+}
+
+template<typename QueuePolicy>
+WakeupStats BasicThreadPool<QueuePolicy>::wakeupStats() const {
+    return {parks.load(), wakeupsIssued.load(), wakeupsAvoided.load()};
+}
+
+template<typename QueuePolicy>
+ThreadPoolStats BasicThreadPool<QueuePolicy>::stats() const {
+    ThreadPoolStats result;
+    for (const auto &counter : counters) {
+        WorkerStats worker;
+        worker.tasksExecuted = counter->tasksExecuted.load(std::memory_order_relaxed);
+        worker.busyNs = counter->busyNs.load(std::memory_order_relaxed);
+        worker.idleNs = counter->idleNs.load(std::memory_order_relaxed);
+        worker.steals = counter->steals.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < kLatencyBuckets; ++b) {
+            worker.queueWait[b] = counter->queueWait[b].load(std::memory_order_relaxed);
+        }
+        result.workers.push_back(worker);
+    }
+    result.wakeups = wakeupStats();
+    result.maxQueueDepth = maxQueueDepth.load(std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t ThreadPoolStats::queueWaitPercentile(double q) const {
+    std::array<uint64_t, kLatencyBuckets> merged{};
+    uint64_t total = 0;
+    for (const auto &worker : workers) {
+        for (size_t b = 0; b < kLatencyBuckets; ++b) {
+            merged[b] += worker.queueWait[b];
+            total += worker.queueWait[b];
+        }
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(q * static_cast<double>(total));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < kLatencyBuckets; ++b) {
+        seen += merged[b];
+        if (seen > target || seen == total) {
+            return b == 0 ? 0 : (uint64_t(1) << b);
+        }
+    }
+    return uint64_t(1) << (kLatencyBuckets - 1);
 }
+
+void ThreadPoolStats::print(std::ostream &out) const {
+    out << "ThreadPool stats: max queue depth " << maxQueueDepth
+        << ", parks " << wakeups.parks
+        << ", wakeups issued " << wakeups.wakeupsIssued
+        << ", wakeups avoided " << wakeups.wakeupsAvoided << std::endl;
+    out << "  queue wait p50 <= " << queueWaitPercentile(0.5) << " ns, p99 <= "
+        << queueWaitPercentile(0.99) << " ns" << std::endl;
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const WorkerStats &worker = workers[i];
+        uint64_t total = worker.busyNs + worker.idleNs;
+        out << "  worker " << i << ": tasks " << worker.tasksExecuted
+            << ", busy " << worker.busyNs / 1000000 << " ms"
+            << ", idle " << worker.idleNs / 1000000 << " ms"
+            << ", utilization " << (total ? 100 * worker.busyNs / total : 0) << "%"
+            << ", steals " << worker.steals << std::endl;
+    }
+}
+
+template class BasicThreadPool<LockedTaskQueue>;
+template class BasicThreadPool<LockFreeTaskQueue>;
@@ -4,48 +4,242 @@
 #include <functional>
 #include <vector>
 #include <thread>
-#include <queue>
+#include <deque>
+#include <memory>
 #include <atomic>
 #include <condition_variable>
+#include <exception>
 #include <future>
 #include <iostream>
+#include <cstdint>
+#include <array>
+#include <ostream>
+#include <tuple>
+#include <type_traits>
+#include "Cancellation.h"
+#include "TaskFunction.h"
+#include "TaskQueue.h"
+#include "Topology.h"
 
-class ThreadPool {
+// 任务调度模式
+enum class SchedulingMode {
+    SharedQueue,   // 所有线程共享一个全局队列
+    WorkStealing   // 每个线程一个本地双端队列，空闲时从其他线程窃取
+};
+
+// 任务优先级，数值越大越先执行。工作线程每取一个任务都从最高优先级开始查找，
+// 因此合并任务（释放内存和磁盘）会在任务边界上抢在排队中的排序任务之前执行
+enum class TaskPriority {
+    RunGeneration,      // 生成有序文件
+    IntermediateMerge,  // 中间层合并
+    FinalMerge          // 最终合并
+};
+
+constexpr size_t kPriorityLevels = 3;
+
+// 有界队列（如无锁环形队列）在未指定容量时使用的默认容量
+constexpr size_t kDefaultQueueCapacity = 1 << 16;
+
+// 线程池的可选配置
+struct ThreadPoolOptions {
+    // 按 CPU 拓扑把工作线程绑定到核心上（各插槽轮流分配），窃取时优先选择同一插槽的线程。
+    // 线程固定后，任务里分配并首次写入的缓冲区都落在该线程所在的 NUMA 节点上。
+    bool pinWorkers = false;
+
+    // 工作线程找不到任务时先忙等 spinIterations 轮（每轮一条 pause 指令），
+    // 再让出 CPU yieldIterations 轮，之后才休眠。都为 0 时立即休眠。
+    size_t spinIterations = 256;
+    size_t yieldIterations = 16;
+
+    // 收集每个工作线程的计数（见 ThreadPoolStats），开销为每个任务三次时钟读取
+    bool collectStats = true;
+
+    // joinAll 时把统计结果打印到 std::cout
+    bool dumpStatsOnShutdown = false;
+};
+
+// 唤醒相关计数，用于观察自旋阶段省掉了多少次唤醒系统调用
+struct WakeupStats {
+    uint64_t parks;           // 工作线程真正进入休眠的次数
+    uint64_t wakeupsIssued;   // 提交任务时唤醒休眠线程的次数（每次一个 futex 系统调用）
+    uint64_t wakeupsAvoided;  // 因已有线程在自旋而省掉的唤醒次数
+};
+
+// 排队延迟直方图的桶数：第 i 个桶统计 [2^(i-1), 2^i) 纳秒，第 0 个桶为 0 纳秒，最后一个桶不设上限
+constexpr size_t kLatencyBuckets = 40;
+
+// 单个工作线程的统计快照
+struct WorkerStats {
+    uint64_t tasksExecuted = 0;
+    uint64_t busyNs = 0;   // 执行任务的时间
+    uint64_t idleNs = 0;   // 两个任务之间查找、自旋、休眠的时间
+    uint64_t steals = 0;   // 从其他线程窃取到的任务数
+    std::array<uint64_t, kLatencyBuckets> queueWait{};  // 任务从提交到开始执行的等待时间直方图
+};
+
+// 整个线程池的统计快照
+struct ThreadPoolStats {
+    std::vector<WorkerStats> workers;
+    WakeupStats wakeups;
+    long maxQueueDepth;  // 队列中待处理任务数的历史最大值
+
+    // 按直方图估算的排队延迟分位数（纳秒，取所在桶的上界），q 取值 0~1
+    uint64_t queueWaitPercentile(double q) const;
+
+    void print(std::ostream &out) const;
+};
+
+// QueuePolicy 决定全局任务队列的实现，见 TaskQueue.h
+template<typename QueuePolicy>
+class BasicThreadPool {
 public:
-    ThreadPool(size_t threads);
-    ~ThreadPool();
+    // queueCapacity 限制全局队列中排队的任务总数，0 表示不限（有界队列策略则取 kDefaultQueueCapacity）。
+    // 队列满时外部线程的提交会阻塞，工作线程向本线程池提交则改为就地执行或进入本地队列。
+    BasicThreadPool(size_t threads, SchedulingMode mode = SchedulingMode::SharedQueue,
+                    size_t queueCapacity = 0, const ThreadPoolOptions &options = ThreadPoolOptions());
+    ~BasicThreadPool();
+
+    // 提交任务并返回 future；只有需要结果时才使用，future 的共享状态需要一次堆分配
+    template<typename F, typename... Args>
+    auto enqueueTask(F&& f, Args&&... args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> {
+        return enqueueTask(TaskPriority::RunGeneration, std::forward<F>(f), std::forward<Args>(args)...);
+    }
 
     template<typename F, typename... Args>
-    auto enqueueTask(F&& f, Args&&... args) -> std::future<typename std::result_of<F(Args...)>::type> {
-        using return_type = typename std::result_of<F(Args...)>::type;
+    auto enqueueTask(TaskPriority priority, F&& f, Args&&... args) -> std::future<std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>> {
+        using return_type = std::invoke_result_t<std::decay_t<F>, std::decay_t<Args>...>;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
-            std::bind(std::forward<F>(f), std::forward<Args>(args)...)
+        std::packaged_task<return_type()> task(
+            [f = std::forward<F>(f), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                return std::apply(std::move(f), std::move(args));
+            }
         );
 
-        std::future<return_type> res = task->get_future();
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            if (stop) {
-                throw std::runtime_error("enqueue on stopped ThreadPool");
+        std::future<return_type> res = task.get_future();
+        pushTask(TaskFunction(std::move(task)), priority);
+        return res;
+    }
+
+    // 提交不关心结果的任务：不创建 future，捕获不超过 TaskFunction::kInlineSize 字节时不分配堆内存。
+    // 任务抛出的异常不会终止工作线程：第一个异常被记录下来，由下一次 waitIdle 重新抛出，其余的丢弃
+    template<typename F>
+    void submit(F&& f, TaskPriority priority = TaskPriority::RunGeneration) {
+        pushTask(TaskFunction(std::forward<F>(f)), priority);
+    }
+
+    // 带取消令牌的提交：任务开始执行前若令牌已被取消则直接丢弃。
+    // 执行中的任务需要自己通过令牌检查取消。
+    template<typename F>
+    void submit(F&& f, const CancellationToken &token, TaskPriority priority = TaskPriority::RunGeneration) {
+        pushTask(TaskFunction([f = std::forward<F>(f), token]() mutable {
+            if (!token.isCancelled()) {
+                f();
             }
+        }), priority);
+    }
 
-            tasks.emplace([task]() { (*task)(); });
+    // 非阻塞提交：全局队列已满时返回 false，f 不会被移动
+    template<typename F>
+    bool trySubmit(F&& f, TaskPriority priority = TaskPriority::RunGeneration) {
+        bool local = (mode == SchedulingMode::WorkStealing && isWorkerThread());
+        if (!local && !tryReserveSlot()) {
+            return false;
         }
-        condition.notify_one();
-        return res;
+        pushTask(TaskFunction(std::forward<F>(f)), priority, !local);
+        return true;
     }
 
+    // 阻塞直到所有已提交的任务（包括执行中派生的任务）都执行完毕，工作线程保持存活，
+    // 线程池可以继续用于下一阶段。不能在本线程池的工作线程中调用。
+    // 上次调用以来有任务抛出异常时，重新抛出其中第一个
+    void waitIdle();
+
     void joinAll();
 
+    // 工作线程数
+    size_t threadCount() const { return parkSlots.size(); }
+
+    // 当前线程在本线程池中的编号；不是本线程池的工作线程时返回 threadCount()
+    size_t currentWorkerIndex() const;
+
+    // 工作线程 worker 绑定的 CPU 所在的 NUMA 节点；没有绑定 CPU 时返回 -1
+    int workerNode(size_t worker) const { return worker < workerCpus.size() ? workerCpus[worker].node : -1; }
+
+    WakeupStats wakeupStats() const;
+
+    // 读取当前统计快照，可在运行中随时调用；各计数分别读取，彼此间不保证严格一致
+    ThreadPoolStats stats() const;
+
 private:
+    // 工作窃取模式下每个线程的本地队列（每个优先级一条）：所有者从尾部取（LIFO），窃取者从头部取（FIFO）
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<QueuedTask> tasks[kPriorityLevels];
+    };
+
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    std::vector<std::unique_ptr<WorkerQueue>> localQueues;
+    std::vector<std::vector<size_t>> victimOrder;  // 每个线程窃取时依次尝试的其他线程
+    std::vector<CpuInfo> workerCpus;               // 绑定的 CPU，未绑定时为空
+    std::vector<std::unique_ptr<QueuePolicy>> tasks;  // 每个优先级一条全局队列
     std::atomic<bool> stop;
-    std::mutex queueMutex;
-    std::condition_variable condition;
+    SchedulingMode mode;
+    std::atomic<long> pendingTasks;   // 所有队列中尚未取出的任务数
+
+    // 休眠与唤醒：每个线程在自己的 futex 字上休眠，唤醒时只叫醒指定的一个线程
+    struct ParkSlot {
+        alignas(64) std::atomic<int> state{0};  // 1 表示已登记休眠
+    };
+    std::vector<std::unique_ptr<ParkSlot>> parkSlots;
+    std::mutex parkMutex;                 // 保护 parkedWorkers
+    std::vector<size_t> parkedWorkers;    // 已休眠的线程，后进先出，优先唤醒缓存更热的线程
+    std::atomic<size_t> idleWorkers;      // 已登记休眠的线程数
+    std::atomic<size_t> spinningWorkers;  // 正在自旋等待任务的线程数
+    size_t spinIterations;
+    size_t yieldIterations;
+    std::atomic<uint64_t> parks;
+    std::atomic<uint64_t> wakeupsIssued;
+    std::atomic<uint64_t> wakeupsAvoided;
+
+    // 每个工作线程的计数只由该线程写入，用 relaxed 读改写，不需要加锁前缀的原子操作
+    struct WorkerCounters {
+        alignas(64) std::atomic<uint64_t> tasksExecuted{0};
+        std::atomic<uint64_t> busyNs{0};
+        std::atomic<uint64_t> idleNs{0};
+        std::atomic<uint64_t> steals{0};
+        std::atomic<uint64_t> queueWait[kLatencyBuckets] = {};
+    };
+    std::vector<std::unique_ptr<WorkerCounters>> counters;
+    bool collectStats;
+    bool dumpStatsOnShutdown;
+    std::atomic<long> maxQueueDepth;
 
-    void workerThread();
+    std::atomic<long> activeTasks;    // 已提交但尚未执行完的任务数
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+    std::mutex errorMutex;
+    std::exception_ptr taskError;     // 第一个从任务中逃出的异常，由 waitIdle 取走
+    size_t capacity;                  // 全局队列容量，0 表示不限
+    std::atomic<size_t> queuedTasks;  // 全局队列中已占用的容量
+    std::atomic<size_t> waitingProducers;
+    std::mutex spaceMutex;
+    std::condition_variable spaceCondition;
+
+    bool isWorkerThread() const;
+    bool tryReserveSlot();
+    void releaseSlot();
+    void pushTask(TaskFunction task, TaskPriority priority, bool slotReserved = false);
+    bool popTask(size_t index, QueuedTask &task);
+    bool spinForTask(size_t index, QueuedTask &task);
+    void invokeTask(TaskFunction &function) noexcept;
+    void runTask(size_t index, QueuedTask &task);
+    void parkWorker(size_t index);
+    void wakeWorker();
+    void finishTask();
+    void workerThread(size_t index);
 };
 
+using ThreadPool = BasicThreadPool<LockedTaskQueue>;
+using LockFreeThreadPool = BasicThreadPool<LockFreeTaskQueue>;
+
 #endif // THREADPOOL_H
@@ -0,0 +1,136 @@
+#include "Topology.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+bool readFirstLine(const std::string &path, std::string &line) {
+    std::ifstream file(path);
+    return file.is_open() && static_cast<bool>(std::getline(file, line));
+}
+
+int readInt(const std::string &path, int fallback) {
+    std::string line;
+    if (!readFirstLine(path, line)) {
+        return fallback;
+    }
+    try {
+        return std::stoi(line);
+    } catch (...) {
+        return fallback;
+    }
+}
+
+}
+
+std::vector<int> parseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        try {
+            size_t dash = range.find('-');
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(range));
+            } else {
+                int first = std::stoi(range.substr(0, dash));
+                int last = std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } catch (...) {
+            // 格式不对的片段直接忽略
+        }
+    }
+    return cpus;
+}
+
+std::vector<CpuInfo> readCpuTopology() {
+    const std::string cpuRoot = "/sys/devices/system/cpu/";
+    const std::string nodeRoot = "/sys/devices/system/node/";
+
+    std::string line;
+    std::vector<int> online;
+    if (readFirstLine(cpuRoot + "online", line)) {
+        online = parseCpuList(line);
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool haveAffinity = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    if (online.empty() && haveAffinity) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                online.push_back(cpu);
+            }
+        }
+    }
+
+    // 节点目录下的 cpulist 给出每个 NUMA 节点包含的 CPU
+    std::map<int, int> nodeOfCpu;
+    for (int node = 0;; ++node) {
+        if (!readFirstLine(nodeRoot + "node" + std::to_string(node) + "/cpulist", line)) {
+            break;
+        }
+        for (int cpu : parseCpuList(line)) {
+            nodeOfCpu[cpu] = node;
+        }
+    }
+
+    std::vector<CpuInfo> cpus;
+    for (int cpu : online) {
+        if (haveAffinity && (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))) {
+            continue;
+        }
+        int package = readInt(cpuRoot + "cpu" + std::to_string(cpu) + "/topology/physical_package_id", 0);
+        auto it = nodeOfCpu.find(cpu);
+        cpus.push_back({cpu, package < 0 ? 0 : package, it == nodeOfCpu.end() ? 0 : it->second});
+    }
+    return cpus;
+}
+
+std::vector<CpuInfo> assignWorkerCpus(const std::vector<CpuInfo> &cpus, size_t count) {
+    // 按（节点，插槽）分组：节点信息不可用时节点都是 0，分组退化为按插槽
+    std::map<std::pair<int, int>, std::vector<CpuInfo>> byNode;
+    for (const auto &cpu : cpus) {
+        byNode[{cpu.node, cpu.package}].push_back(cpu);
+    }
+    for (auto &entry : byNode) {
+        std::sort(entry.second.begin(), entry.second.end(),
+                  [](const CpuInfo &a, const CpuInfo &b) { return a.cpu < b.cpu; });
+    }
+
+    // 各组轮流取一个 CPU，得到交错的顺序
+    std::vector<CpuInfo> order;
+    for (size_t round = 0; order.size() < cpus.size(); ++round) {
+        for (const auto &entry : byNode) {
+            if (round < entry.second.size()) {
+                order.push_back(entry.second[round]);
+            }
+        }
+    }
+
+    std::vector<CpuInfo> assigned;
+    for (size_t i = 0; i < count && !order.empty(); ++i) {
+        assigned.push_back(order[i % order.size()]);
+    }
+    return assigned;
+}
+
+bool pinCurrentThread(int cpu) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -0,0 +1,27 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+// 逻辑 CPU 的拓扑信息，来自 /sys/devices/system 下的 sysfs 文件
+struct CpuInfo {
+    int cpu;      // 逻辑 CPU 编号
+    int package;  // 物理插槽（socket）编号
+    int node;     // NUMA 节点编号
+};
+
+// 解析 "0-3,8,10-11" 形式的 CPU 列表
+std::vector<int> parseCpuList(const std::string &list);
+
+// 读取当前进程允许运行的所有在线 CPU 的拓扑；sysfs 不可用时插槽和节点均视为 0
+std::vector<CpuInfo> readCpuTopology();
+
+// 为 count 个工作线程分配 CPU：按 NUMA 节点（节点信息不可用时按插槽）轮流分配，
+// 使线程和它们第一次写入的缓冲区均匀分布到各节点的内存上，同一节点内按 CPU 编号依次使用。CPU 不够时循环复用。
+std::vector<CpuInfo> assignWorkerCpus(const std::vector<CpuInfo> &cpus, size_t count);
+
+// 把调用线程绑定到指定 CPU
+bool pinCurrentThread(int cpu);
+
+#endif // TOPOLOGY_H
@@ -10,124 +10,68 @@
 #include <functional>
 #include <filesystem>
 #include <atomic>
+#include <memory>
+#include "ThreadPool.h"
+#include "DecimalParser.h"
+#include "RunFormat.h"
 
 namespace fs = std::filesystem;
 
-class ThreadPool {
-public:
-    ThreadPool(size_t numThreads);
-    ~ThreadPool();
-    void enqueueTask(std::function<void()> task);
-
-private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queueMutex;
-    std::condition_variable condition;
-    bool stop;
-
-    void workerThread();
-};
-
-ThreadPool::ThreadPool(size_t numThreads) : stop(false) {
-    for (size_t i = 0; i < numThreads; ++i) {
-        workers.emplace_back([this] { workerThread(); });
-    }
-}
-
-ThreadPool::~ThreadPool() {
-    {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        stop = true;
-    }
-    condition.notify_all();
-    for (std::thread &worker : workers) {
-        worker.join();
-    }
-}
-
-void ThreadPool::enqueueTask(std::function<void()> task) {
-    {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        tasks.push(task);
-    }
-    condition.notify_one();
-}
-
-void ThreadPool::workerThread() {
-    while (true) {
-        std::function<void()> task;
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            condition.wait(lock, [this] { return stop || !tasks.empty(); });
-            if (stop && tasks.empty())
-                return;
-            task = std::move(tasks.front());
-            tasks.pop();
-        }
-        task();
-    }
-}
-
 void sortAndWriteFile(const std::string &inputFilePath, const std::string &outputFilePath) {
-    std::ifstream inputFile(inputFilePath);
-    if (!inputFile.is_open()) {
-        std::cerr << "Error opening input file: " << inputFilePath << std::endl;
-        return;
-    }
-
     std::vector<int64_t> data;
-    int64_t value;
-    while (inputFile >> value) {
-        data.push_back(value);
+    try {
+        DecimalReader reader(inputFilePath);
+        int64_t value;
+        while (reader.next(value)) {
+            data.push_back(value);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return;
     }
-    inputFile.close();
 
     std::sort(data.begin(), data.end());
 
-    std::ofstream outputFile(outputFilePath);
-    if (!outputFile.is_open()) {
-        std::cerr << "Error opening output file: " << outputFilePath << std::endl;
-        return;
+    try {
+        TextWriter outputFile(outputFilePath);
+        outputFile.writeBlock(data.data(), data.size());
+        outputFile.close();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
     }
-
-    for (const auto &val : data) {
-        outputFile << val << "\n";
-    }
-    outputFile.close();
 }
 
 void mergeFiles(const std::vector<std::string> &inputFiles, const std::string &outputFilePath) {
-    std::priority_queue<std::pair<int64_t, std::ifstream*>, std::vector<std::pair<int64_t, std::ifstream*>>, std::greater<>> minHeap;
-    std::vector<std::ifstream> inputStreams;
+    std::priority_queue<std::pair<int64_t, DecimalReader*>, std::vector<std::pair<int64_t, DecimalReader*>>, std::greater<>> minHeap;
+    std::vector<std::unique_ptr<DecimalReader>> inputStreams;
 
     for (const auto &file : inputFiles) {
-        inputStreams.emplace_back(file);
-        if (inputStreams.back().is_open()) {
+        try {
+            inputStreams.push_back(std::make_unique<DecimalReader>(file));
             int64_t value;
-            if (inputStreams.back() >> value) {
-                minHeap.emplace(value, &inputStreams.back());
+            if (inputStreams.back()->next(value)) {
+                minHeap.emplace(value, inputStreams.back().get());
             }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
         }
     }
 
-    std::ofstream outputFile(outputFilePath);
-    if (!outputFile.is_open()) {
-        std::cerr << "Error opening output file: " << outputFilePath << std::endl;
-        return;
-    }
-
-    while (!minHeap.empty()) {
-        auto [val, stream] = minHeap.top();
-        minHeap.pop();
-        outputFile << val << "\n";
+    try {
+        TextWriter outputFile(outputFilePath);
+        while (!minHeap.empty()) {
+            auto [val, stream] = minHeap.top();
+            minHeap.pop();
+            outputFile.write(val);
 
-        if (*stream >> val) {
-            minHeap.emplace(val, stream);
+            if (stream->next(val)) {
+                minHeap.emplace(val, stream);
+            }
         }
+        outputFile.close();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
     }
-
-    outputFile.close();
 }
 
 int main() {
@@ -144,7 +88,7 @@ int main() {
             std::string inputFilePath = entry.path().string();
             std::string outputFilePath = inputFilePath + ".sorted";
 
-            threadPool.enqueueTask([inputFilePath, outputFilePath, &sortedFilePaths, &sortedFilesMutex] {
+            threadPool.submit([inputFilePath, outputFilePath, &sortedFilePaths, &sortedFilesMutex] {
                 sortAndWriteFile(inputFilePath, outputFilePath);
                 {
                     std::lock_guard<std::mutex> lock(sortedFilesMutex);
@@ -154,10 +98,12 @@ int main() {
         }
     }
 
-    // Wait for all sorting tasks to complete by destroying the thread pool
-    // (This will wait for all threads to finish their tasks)
-    {
-        ThreadPool tempPool(0); // Temporary object to ensure all tasks complete
+    // 等待所有排序任务完成，线程池保持存活；任务中抛出的第一个异常在这里重新抛出
+    try {
+        threadPool.waitIdle();
+    } catch (const std::exception &e) {
+        std::cerr << "Sorting failed: " << e.what() << std::endl;
+        return 1;
     }
 
     // Merge all sorted files into the final output file
@@ -0,0 +1,594 @@
+// kernel_tests.cpp
+// SIMD 解析、排序、编解码和败者树多路合并的正确性测试：每种实现都与标准库（或标量实现）的结果逐个比较。
+// 任一检查失败时返回非 0，由 ctest 运行
+#include "DecimalParser.h"
+#include "SortKernel.h"
+#include "RunCodec.h"
+#include "RunFormat.h"
+#include "LoserTree.h"
+#include "SortMerge.h"
+#include "ReplacementSelection.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+
+int failures = 0;
+
+void check(bool ok, const std::string &what) {
+    if (!ok) {
+        ++failures;
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+}
+
+// 测试数据的分布：全范围随机、取值很少（大量重复）、夹杂 INT64_MIN/INT64_MAX、已有序、逆序
+enum class Shape {
+    Random,
+    FewValues,
+    Extremes,
+    Sorted,
+    Reversed
+};
+
+const char *shapeName(Shape shape) {
+    switch (shape) {
+    case Shape::Random:
+        return "random";
+    case Shape::FewValues:
+        return "few-values";
+    case Shape::Extremes:
+        return "extremes";
+    case Shape::Sorted:
+        return "sorted";
+    default:
+        return "reversed";
+    }
+}
+
+std::vector<int64_t> makeData(size_t count, Shape shape, std::mt19937_64 &rng) {
+    std::vector<int64_t> data(count);
+    for (auto &value : data) {
+        switch (shape) {
+        case Shape::FewValues:
+            value = static_cast<int64_t>(rng() % 7) - 3;
+            break;
+        case Shape::Extremes: {
+            uint64_t pick = rng() % 4;
+            value = pick == 0 ? kMin : pick == 1 ? kMax : static_cast<int64_t>(rng());
+            break;
+        }
+        default:
+            value = static_cast<int64_t>(rng());
+            break;
+        }
+    }
+    if (shape == Shape::Sorted) {
+        std::sort(data.begin(), data.end());
+    } else if (shape == Shape::Reversed) {
+        std::sort(data.rbegin(), data.rend());
+    }
+    return data;
+}
+
+// 参考实现：按空白切分，每个记号用 std::from_chars 解析（from_chars 不接受 '+'，先去掉）。
+// 任一记号格式错误或超出 int64 范围时返回 false
+bool referenceParse(const std::string &text, std::vector<int64_t> &out) {
+    size_t pos = 0;
+    while (true) {
+        pos = text.find_first_not_of(" \t\n\r\v\f", pos);
+        if (pos == std::string::npos) {
+            return true;
+        }
+        size_t end = std::min(text.find_first_of(" \t\n\r\v\f", pos), text.size());
+        const char *first = text.data() + pos;
+        const char *last = text.data() + end;
+        if (*first == '+' && last - first > 1 && first[1] != '-') {
+            ++first;
+        }
+        int64_t value;
+        auto [next, error] = std::from_chars(first, last, value);
+        if (error != std::errc() || next != last) {
+            return false;
+        }
+        out.push_back(value);
+        pos = end;
+    }
+}
+
+// 每种实现解析 text，与参考实现比较：合法时结果相同，不合法时必须抛出 std::runtime_error。
+// text 复制到大小恰好的缓冲区，最后一个记号正好在缓冲区末尾结束
+void checkParse(const std::string &text, const std::string &what) {
+    std::vector<int64_t> expected;
+    bool valid = referenceParse(text, expected);
+    std::vector<char> buffer(text.begin(), text.end());
+    for (DecimalParserKind kind : {DecimalParserKind::Scalar, DecimalParserKind::Sse41, DecimalParserKind::Avx2}) {
+        std::vector<int64_t> values;
+        bool threw = false;
+        try {
+            parseDecimalInts(kind, buffer.data(), buffer.data() + buffer.size(), values, "test");
+        } catch (const std::runtime_error &) {
+            threw = true;
+        }
+        std::string label = std::string("parser ") + decimalParserName(kind) + ", " + what;
+        if (valid) {
+            check(!threw && values == expected, label);
+        } else {
+            check(threw, label + ": malformed input accepted");
+        }
+    }
+}
+
+// 单个记号放在不同的位置：前面补空白使它跨过 16/32 字节窗口的各个位置，后面没有分隔符（在缓冲区末尾结束）、
+// 有分隔符，或者后面还有一个数
+void testDecimalParserTokens() {
+    const std::string zeros17(17, '0');
+    const std::string zeros33(33, '0');
+    const std::string tokens[] = {
+        "0", "-0", "+0", "7", "-7", "+7", "1234567890123456", "12345678901234567", "-12345678901234567890",
+        "9223372036854775807", "+9223372036854775807", "-9223372036854775808", "9223372036854775806", "-9223372036854775807",
+        zeros17 + "1", zeros33 + "1", "-" + zeros17 + "9223372036854775808", "+" + zeros33 + "9223372036854775807", zeros33,
+        // 超出范围（各差 1）、超出 uint64、位数很多
+        "9223372036854775808", "-9223372036854775809", "18446744073709551615", "18446744073709551616", "-18446744073709551616",
+        "99999999999999999999999999999999999", zeros33 + "9223372036854775808",
+        // 格式错误
+        "-", "+", "--1", "+-1", "-+1", "12a", "12-3", "1.5", "abc", "0x10", "１"};
+    for (const auto &token : tokens) {
+        for (size_t pad = 0; pad <= 40; ++pad) {
+            std::string prefix(pad, pad % 3 == 0 ? '\n' : ' ');
+            checkParse(prefix + token, "token \"" + token + "\" at end after " + std::to_string(pad) + " blanks");
+            checkParse(prefix + token + "\n", "token \"" + token + "\" after " + std::to_string(pad) + " blanks");
+            checkParse(prefix + token + " -42", "token \"" + token + "\" followed by a number after " + std::to_string(pad) + " blanks");
+        }
+    }
+}
+
+// 随机混合合法与不合法的记号，分隔符随机
+void testDecimalParserRandom() {
+    std::mt19937_64 rng(14);
+    const char *separators[] = {" ", "\n", "\r\n", "\t", "  \n "};
+    for (int round = 0; round < 2000; ++round) {
+        std::string text;
+        size_t tokens = rng() % 40;
+        bool allowJunk = round % 4 == 0;
+        for (size_t i = 0; i < tokens; ++i) {
+            if (i > 0) {
+                text += separators[rng() % std::size(separators)];
+            }
+            uint64_t kind = rng() % 10;
+            if (kind == 0) {
+                text += std::to_string(rng() % 2 ? kMin : kMax);
+            } else if (kind == 1) {
+                text += std::string(rng() % 40, '0') + std::to_string(rng() % 1000);
+            } else if (kind == 2 && allowJunk) {
+                text += rng() % 2 ? "12x" : "-";
+            } else {
+                text += std::to_string(static_cast<int64_t>(rng()) >> (rng() % 64));
+            }
+        }
+        checkParse(text, "random text " + std::to_string(round));
+    }
+}
+
+// 长度覆盖：小于排序网络的最小长度、不是寄存器组和 L1 块的整数倍、跨多个块
+const size_t kSortSizes[] = {0, 1, 2, 7, 15, 16, 17, 31, 33, 63, 64, 65, 1000, 1023, 1024, 1025, 4095, 4097, 65537, 300007};
+const Shape kShapes[] = {Shape::Random, Shape::FewValues, Shape::Extremes, Shape::Sorted, Shape::Reversed};
+
+// 每种指令集的双调排序与 std::sort 比较；CPU 不支持的指令集会退回 std::sort，结果同样必须正确
+void testBitonicSort() {
+    std::mt19937_64 rng(21);
+    for (BitonicIsa isa : {BitonicIsa::Avx2, BitonicIsa::Avx512}) {
+        for (size_t count : kSortSizes) {
+            for (Shape shape : kShapes) {
+                std::vector<int64_t> data = makeData(count, shape, rng);
+                std::vector<int64_t> expected = data;
+                std::sort(expected.begin(), expected.end());
+                std::vector<int64_t> scratch;
+                bitonicSort(isa, data, scratch);
+                check(data == expected, std::string("bitonicSort ") + bitonicIsaName(isa) + ", " + std::to_string(count) +
+                                            " " + shapeName(shape) + " values");
+            }
+        }
+    }
+}
+
+// 基数排序各种位数与 std::sort 比较。长度覆盖退回 std::sort 的阈值（4096）两侧；
+// 取值有全负、正负混合，以及某些位在所有数上都相同（跳过这些趟，结果可能留在 scratch 中再换回 data）
+void testRadixSort() {
+    std::mt19937_64 rng(16);
+    const size_t sizes[] = {0, 1, 2, 4095, 4096, 4097, 10000, 100003};
+    // 生成一个数：各种分布由 pattern 选择
+    auto makeValue = [&rng](int pattern) -> int64_t {
+        switch (pattern) {
+        case 0:
+            return static_cast<int64_t>(rng());                                    // 全范围
+        case 1:
+            return -1 - static_cast<int64_t>(rng() >> 1);                          // 全负
+        case 2:
+            return static_cast<int64_t>(rng() % 2000001) - 1000000;               // 正负混合，高位只有两种
+        case 3:
+            return static_cast<int64_t>((rng() % 4096) << 20) - (int64_t{1} << 30);  // 低 20 位恒为 0，跳过低位的趟
+        case 4:
+            return static_cast<int64_t>(rng() % 256) << 40;                        // 只有一个字节在变，只剩一趟
+        case 5: {
+            uint64_t pick = rng() % 3;
+            return pick == 0 ? kMin : pick == 1 ? kMax : static_cast<int64_t>(rng() % 5) - 2;
+        }
+        default:
+            return 42;                                                             // 全部相同，每一趟都跳过
+        }
+    };
+    for (RadixDigitBits bits : {RadixDigitBits::Bits8, RadixDigitBits::Bits11, RadixDigitBits::Bits16}) {
+        for (size_t count : sizes) {
+            for (int pattern = 0; pattern <= 6; ++pattern) {
+                std::vector<int64_t> data(count);
+                for (auto &value : data) {
+                    value = makeValue(pattern);
+                }
+                std::vector<int64_t> expected = data;
+                std::sort(expected.begin(), expected.end());
+                std::vector<int64_t> scratch;
+                radixSort(data, scratch, bits);
+                check(data == expected, "radixSort " + std::to_string(static_cast<int>(bits)) + "-bit, " + std::to_string(count) +
+                                            " values, pattern " + std::to_string(pattern));
+            }
+        }
+    }
+}
+
+// 由 runs 个升序段拼成的数据：每段末尾放一个比下一段所有数都大的数，段与段之间一定断开
+std::vector<int64_t> makeAscendingRuns(size_t runs, size_t runValues, std::mt19937_64 &rng) {
+    std::vector<int64_t> data;
+    for (size_t run = 0; run < runs; ++run) {
+        std::vector<int64_t> segment(runValues);
+        for (auto &value : segment) {
+            value = static_cast<int64_t>(rng() % 1000000) - 500000;
+        }
+        std::sort(segment.begin(), segment.end());
+        segment.push_back(500000 + static_cast<int64_t>(run));
+        data.insert(data.end(), segment.begin(), segment.end());
+    }
+    return data;
+}
+
+// 预扫描 + 直接归并与 std::sort 比较，并检查识别出的有序段数；每种 SortKernel 各测一遍
+void testAdaptiveSort() {
+    std::mt19937_64 rng(24);
+    for (SortKernel kernel : {SortKernel::StdSort, SortKernel::Radix, SortKernel::Bitonic}) {
+        std::string name = std::string("sortValuesAdaptive ") + sortKernelName(kernel) + ", ";
+        // scratch 预留到 data 的大小，归并可以进行；或者容量不够，退回按 kernel 排序
+        auto run = [&](std::vector<int64_t> data, bool enoughScratch, size_t naturalRuns, size_t reversedRuns, const std::string &what) {
+            std::vector<int64_t> expected = data;
+            std::sort(expected.begin(), expected.end());
+            std::vector<int64_t> scratch;
+            scratch.reserve(enoughScratch ? data.size() : data.size() / 2);
+            Presortedness order = sortValuesAdaptive(data, scratch, kernel);
+            std::string label = name + what + (enoughScratch ? "" : ", small scratch");
+            check(data == expected, label);
+            check(order.naturalRuns == naturalRuns, label + ": natural runs " + std::to_string(order.naturalRuns));
+            check(order.naturalRuns == 0 || order.reversedRuns == reversedRuns, label + ": reversed runs " + std::to_string(order.reversedRuns));
+        };
+        for (bool enoughScratch : {true, false}) {
+            for (size_t count : {size_t{1}, size_t{2}, size_t{100}, size_t{10000}}) {
+                std::vector<int64_t> sorted = makeData(count, Shape::Random, rng);
+                std::sort(sorted.begin(), sorted.end());
+                run(sorted, enoughScratch, 1, 0, std::to_string(count) + " sorted values");
+
+                // 严格降序
+                std::vector<int64_t> reversed(sorted.rbegin(), sorted.rend());
+                reversed.erase(std::unique(reversed.begin(), reversed.end()), reversed.end());
+                run(reversed, enoughScratch, 1, reversed.size() > 1 ? 1 : 0, std::to_string(reversed.size()) + " strictly reversed values");
+
+                // 带大量相等值的降序：就地反转后仍必须与 std::sort 的结果相同
+                std::vector<int64_t> ties = makeData(count, Shape::FewValues, rng);
+                std::sort(ties.rbegin(), ties.rend());
+                bool descends = ties.size() > 1 && ties.back() < ties.front();
+                run(ties, enoughScratch, 1, descends ? 1 : 0, std::to_string(count) + " reversed values with ties");
+            }
+            // 有序段数在阈值两侧：不超过 kMaxNaturalRuns 时直接归并，超过时按 kernel 排序（段数报告为 0）
+            for (size_t runs : {size_t{2}, kMaxNaturalRuns - 1, kMaxNaturalRuns, kMaxNaturalRuns + 1, kMaxNaturalRuns * 4}) {
+                run(makeAscendingRuns(runs, 777, rng), enoughScratch, runs <= kMaxNaturalRuns ? runs : 0, 0,
+                    std::to_string(runs) + " ascending runs");
+            }
+            // 升序段和降序段交替
+            std::vector<int64_t> mixed = makeAscendingRuns(3, 500, rng);
+            std::vector<int64_t> down = makeAscendingRuns(1, 500, rng);
+            std::sort(down.rbegin(), down.rend());
+            down.push_back(kMin);
+            mixed.insert(mixed.end(), down.begin(), down.end());
+            run(mixed, enoughScratch, 4, 1, "three ascending runs and one descending run");
+        }
+        run(std::vector<int64_t>(), true, 0, 0, "empty input");
+        run(makeData(100000, Shape::Random, rng), true, 0, 0, "random values");
+    }
+}
+
+// 编码后用两种解码实现分别还原：位宽 0..64 的每一种、不满一块的长度，以及差值按无符号回绕的乱序数据
+void testCodecBlocks() {
+    std::mt19937_64 rng(23);
+    std::vector<char> encoded(kMaxEncodedBlockBytes);
+    int64_t scalar[kCodecBlockValues];
+    int64_t simd[kCodecBlockValues];
+    for (unsigned width = 0; width <= 64; ++width) {
+        for (size_t count : {size_t{1}, size_t{2}, size_t{3}, size_t{4}, size_t{5}, size_t{63}, size_t{127}, kCodecBlockValues}) {
+            // 相邻差值不超过 width 位；width 为 64 时允许任意差值
+            std::vector<int64_t> values(count);
+            uint64_t mask = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+            values[0] = width % 2 ? kMin : static_cast<int64_t>(rng());
+            for (size_t i = 1; i < count; ++i) {
+                values[i] = static_cast<int64_t>(static_cast<uint64_t>(values[i - 1]) + (rng() & mask));
+            }
+            size_t bytes = encodeRunBlock(values.data(), count, encoded.data());
+            std::string what = "codec width " + std::to_string(width) + ", " + std::to_string(count) + " values";
+            check(bytes <= kMaxEncodedBlockBytes && bytes == encodedBlockBytes(static_cast<unsigned char>(encoded[0])), what + ": size");
+            check(decodeRunBlock(CodecIsa::Scalar, encoded.data(), scalar) == bytes, what + ": scalar bytes read");
+            check(decodeRunBlock(CodecIsa::Avx2, encoded.data(), simd) == bytes, what + ": avx2 bytes read");
+            check(std::equal(values.begin(), values.end(), scalar), what + ": scalar decode");
+            check(std::equal(scalar, scalar + kCodecBlockValues, simd), what + ": avx2 decode differs from scalar");
+        }
+    }
+
+    // 有序 run 的两端
+    const int64_t edges[] = {kMin, kMin, kMin + 1, -1, 0, 1, kMax - 1, kMax, kMax};
+    size_t bytes = encodeRunBlock(edges, std::size(edges), encoded.data());
+    check(bytes == encodedBlockBytes(64), "codec INT64_MIN..INT64_MAX block width");
+    decodeRunBlock(CodecIsa::Scalar, encoded.data(), scalar);
+    decodeRunBlock(CodecIsa::Avx2, encoded.data(), simd);
+    check(std::equal(std::begin(edges), std::end(edges), scalar), "codec INT64_MIN..INT64_MAX scalar decode");
+    check(std::equal(scalar, scalar + kCodecBlockValues, simd), "codec INT64_MIN..INT64_MAX avx2 decode");
+}
+
+// 写成压缩 run 文件再读回：长度不是块的整数倍，缓冲区大小不同
+void testCodecRunFiles(const std::filesystem::path &directory) {
+    std::mt19937_64 rng(230);
+    const std::string path = (directory / "codec.run").string();
+    for (size_t count : {0, 1, 127, 128, 129, 1000, 65537}) {
+        for (Shape shape : kShapes) {
+            std::vector<int64_t> values = makeData(count, shape, rng);
+            std::sort(values.begin(), values.end());
+            for (size_t bufferBytes : {size_t{64}, size_t{4096}, size_t{1} << 20}) {
+                {
+                    RunWriter writer(path, bufferBytes, RunCodec::DeltaPacked);
+                    writer.writeBlock(values.data(), values.size());
+                    writer.close();
+                }
+                RunReader reader(path, bufferBytes);
+                std::vector<int64_t> readBack;
+                int64_t value;
+                while (reader.next(value)) {
+                    readBack.push_back(value);
+                }
+                check(readBack == values && reader.header().count == count,
+                      "packed run file, " + std::to_string(count) + " " + shapeName(shape) + " values, buffer " +
+                          std::to_string(bufferBytes));
+            }
+        }
+    }
+}
+
+// 把合并结果收集到内存中
+struct VectorWriter {
+    std::vector<int64_t> values;
+
+    void write(int64_t value) { values.push_back(value); }
+    void writeBlock(const int64_t *block, size_t count) { values.insert(values.end(), block, block + count); }
+};
+
+// 败者树多路合并与 std::sort 比较：0..40 路、空 run、大量重复值、INT64_MIN/INT64_MAX（与读完的输入的哨兵相同）。
+// 直接使用 LoserTree 时每次只取几个数，覆盖分批输出，自己读文件和由调用方读文件各一次；再经 mergeFiles 输出 run 和文本各一次
+void testLoserTree(const std::filesystem::path &directory) {
+    std::mt19937_64 rng(25);
+    for (size_t k = 0; k <= 40; ++k) {
+        for (Shape shape : {Shape::Random, Shape::FewValues, Shape::Extremes}) {
+            std::vector<std::string> paths;
+            std::vector<int64_t> expected;
+            for (size_t i = 0; i < k; ++i) {
+                std::vector<int64_t> values = makeData(rng() % 4 == 0 ? 0 : rng() % 3000, shape, rng);
+                std::sort(values.begin(), values.end());
+                expected.insert(expected.end(), values.begin(), values.end());
+                paths.push_back((directory / ("merge_input_" + std::to_string(i) + ".run")).string());
+                writeRun(paths.back(), values);
+            }
+            std::sort(expected.begin(), expected.end());
+            std::string what = "loser tree, " + std::to_string(k) + " " + shapeName(shape) + " runs";
+
+            std::vector<std::unique_ptr<RunReader>> readers;
+            std::vector<RunReader *> inputs;
+            for (const auto &path : paths) {
+                readers.push_back(std::make_unique<RunReader>(path, 256));
+                inputs.push_back(readers.back().get());
+            }
+            LoserTree tree(inputs);
+            VectorWriter writer;
+            while (tree.writeNext(writer, 1 + rng() % 100) > 0) {
+            }
+            check(writer.values == expected && !tree.hasNext(), what);
+
+            // 调用方负责读文件：输入的缓冲区取完时 writeNext 提前返回，由这里 refill 后 resume
+            std::vector<std::unique_ptr<RunReader>> pausedReaders;
+            std::vector<RunReader *> pausedInputs;
+            for (const auto &path : paths) {
+                pausedReaders.push_back(std::make_unique<RunReader>(path, 256));
+                pausedReaders.back()->refill();
+                pausedInputs.push_back(pausedReaders.back().get());
+            }
+            LoserTree pausing(pausedInputs, true);
+            VectorWriter paused;
+            bool starvedWhileReady = false;
+            while (pausing.hasNext()) {
+                pausing.writeNext(paused, 1 + rng() % 100);
+                if (RunReader *reader = pausing.starvedReader()) {
+                    starvedWhileReady = starvedWhileReady || reader->ready();
+                    reader->refill();
+                    pausing.resume();
+                }
+            }
+            check(paused.values == expected && !starvedWhileReady, what + ", caller refills");
+
+            std::string runPath = (directory / "merged.run").string();
+            mergeFiles(paths, runPath, OutputFormat::BinaryRun, 4096);
+            RunReader reader(runPath, 4096);
+            std::vector<int64_t> merged;
+            int64_t value;
+            while (reader.next(value)) {
+                merged.push_back(value);
+            }
+            check(merged == expected, what + " via mergeFiles");
+
+            std::string textPath = (directory / "merged.txt").string();
+            mergeFiles(paths, textPath, OutputFormat::Text, 4096);
+            std::ifstream text(textPath);
+            std::vector<int64_t> lines;
+            long long line;
+            while (text >> line) {
+                lines.push_back(line);
+            }
+            check(lines == expected, what + " via mergeFiles to text");
+        }
+    }
+}
+
+
+// 用容量为 capacity 的堆做置换选择，每次 add 最多 piece 个数（0 表示一次 add 全部），读回各个 run
+std::vector<std::vector<int64_t>> replacementSelectionRuns(const std::filesystem::path &directory, const std::vector<int64_t> &input,
+                                                           size_t capacity, size_t piece) {
+    std::vector<int64_t> storage;
+    storage.reserve(capacity);
+    size_t runCount = 0;
+    ReplacementSelection selection(storage, 4096, [&] {
+        return (directory / ("selection_" + std::to_string(runCount++) + ".run")).string();
+    });
+    for (size_t offset = 0; offset < input.size();) {
+        size_t count = piece == 0 ? input.size() : std::min(piece, input.size() - offset);
+        selection.add(input.data() + offset, count);
+        offset += count;
+    }
+    selection.finish();
+
+    std::vector<std::vector<int64_t>> runs;
+    for (const auto &path : selection.runPaths()) {
+        RunReader reader(path, 4096);
+        runs.emplace_back();
+        int64_t value;
+        while (reader.next(value)) {
+            runs.back().push_back(value);
+        }
+    }
+    for (const auto &path : selection.runPaths()) {
+        std::filesystem::remove(path);
+    }
+    return runs;
+}
+
+// 每个 run 都有序，所有 run 合起来恰好是输入的数
+bool runsHoldInput(const std::vector<std::vector<int64_t>> &runs, const std::vector<int64_t> &input) {
+    std::vector<int64_t> all;
+    for (const auto &run : runs) {
+        if (run.empty() || !std::is_sorted(run.begin(), run.end())) {
+            return false;
+        }
+        all.insert(all.end(), run.begin(), run.end());
+    }
+    std::sort(all.begin(), all.end());
+    std::vector<int64_t> expected = input;
+    std::sort(expected.begin(), expected.end());
+    return all == expected;
+}
+
+void testReplacementSelection(const std::filesystem::path &directory) {
+    std::mt19937_64 rng(20);
+    for (size_t capacity : {size_t{1}, size_t{7}, size_t{1000}}) {
+        // 堆很小时 run 很多，每个 run 一个文件，大输入按容量缩小
+        for (size_t count : {size_t{0}, size_t{1}, capacity - 1, capacity, capacity + 1, 20 * capacity + 200}) {
+            std::string size = std::to_string(count) + " values, heap of " + std::to_string(capacity);
+            for (Shape shape : kShapes) {
+                std::vector<int64_t> input = makeData(count, shape, rng);
+                std::string what = std::string("replacement selection, ") + shapeName(shape) + ", " + size;
+                auto runs = replacementSelectionRuns(directory, input, capacity, 0);
+                check(runsHoldInput(runs, input), what);
+                check(runs.size() == (count == 0 ? 0 : 1) || (shape != Shape::Sorted && count > capacity), what + ": run count");
+                // 分批 add 与一次 add 的结果完全相同
+                for (size_t piece : {size_t{1}, size_t{3}, capacity, size_t{4096}}) {
+                    check(replacementSelectionRuns(directory, input, capacity, piece) == runs,
+                          what + ", add " + std::to_string(piece) + " at a time");
+                }
+            }
+
+            // 逆序输入：每个新数都进入下一个 run，除最后一个外每个 run 恰好是堆的容量
+            std::vector<int64_t> reversed = makeData(count, Shape::Reversed, rng);
+            auto runs = replacementSelectionRuns(directory, reversed, capacity, 0);
+            bool capacityRuns = runs.size() == (count + capacity - 1) / capacity;
+            for (size_t i = 0; i < runs.size(); ++i) {
+                capacityRuns = capacityRuns && (i + 1 == runs.size() ? runs[i].size() <= capacity : runs[i].size() == capacity);
+            }
+            check(runsHoldInput(runs, reversed) && capacityRuns, "replacement selection, strictly reversed, " + size);
+        }
+
+        // 带大量相等值的有序输入：与刚输出的数相等的数留在当前 run
+        std::vector<int64_t> ties = makeData(20000, Shape::FewValues, rng);
+        std::sort(ties.begin(), ties.end());
+        auto tiedRuns = replacementSelectionRuns(directory, ties, capacity, 0);
+        check(runsHoldInput(tiedRuns, ties) && tiedRuns.size() == 1,
+              "replacement selection, sorted values with ties, heap of " + std::to_string(capacity));
+
+        // 接近有序：在长度为容量一半的小段内打乱，每个数离自己的位置都不到一个堆，仍只产生一个 run
+        std::vector<int64_t> nearlySorted = makeData(20000, Shape::Random, rng);
+        std::sort(nearlySorted.begin(), nearlySorted.end());
+        size_t window = std::max<size_t>(capacity / 2, 1);
+        for (size_t begin = 0; begin < nearlySorted.size(); begin += window) {
+            auto first = nearlySorted.begin() + static_cast<std::ptrdiff_t>(begin);
+            std::shuffle(first, first + static_cast<std::ptrdiff_t>(std::min(window, nearlySorted.size() - begin)), rng);
+        }
+        auto runs = replacementSelectionRuns(directory, nearlySorted, capacity, 0);
+        check(runsHoldInput(runs, nearlySorted) && runs.size() == 1,
+              "replacement selection, nearly sorted, heap of " + std::to_string(capacity) + ": " + std::to_string(runs.size()) + " runs");
+    }
+}
+
+}
+
+int main() {
+    std::cout << "Decimal parser on this CPU: " << decimalParserName(activeDecimalParser()) << std::endl;
+    testDecimalParserTokens();
+    testDecimalParserRandom();
+
+    std::cout << "Bitonic ISA on this CPU: " << bitonicIsaName(activeBitonicIsa()) << std::endl;
+    testBitonicSort();
+    testRadixSort();
+    testAdaptiveSort();
+
+    std::cout << "Codec ISA on this CPU: " << (activeCodecIsa() == CodecIsa::Avx2 ? "avx2" : "scalar") << std::endl;
+    testCodecBlocks();
+
+    // 临时文件放在单独的目录里，结束时整个删除
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "kernel_tests";
+    std::filesystem::create_directories(directory);
+    try {
+        testCodecRunFiles(directory);
+        testLoserTree(directory);
+        testReplacementSelection(directory);
+    } catch (const std::exception &e) {
+        check(false, std::string("exception: ") + e.what());
+    }
+    std::filesystem::remove_all(directory);
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All kernel tests passed" << std::endl;
+    return 0;
+}
@@ -6,101 +6,620 @@
 #include <filesystem>
 #include <future>
 #include <queue>
+#include <deque>
 #include <mutex>
+#include <cctype>
+#include <stdexcept>
+#include <memory>
+#include <optional>
 #include "ThreadPool.h"
+#include "TaskGraph.h"
+#include "Cancellation.h"
+#include "Coroutine.h"
+#include "RunFormat.h"
+#include "DecimalParser.h"
+#include "SortKernel.h"
+#include "LoserTree.h"
+#include "MemoryBudget.h"
+#include "ReplacementSelection.h"
+#include "RunBufferPool.h"
 
 namespace fs = std::filesystem;
 
-void sortFile(const std::string &inputFilePath, const std::string &outputFilePath) {
-    std::ifstream inFile(inputFilePath);
-    if (!inFile.is_open()) {
-        std::cerr << "Error opening input file: " << inputFilePath << std::endl;
-        return;
+// 排序流程的内存预算：run 缓冲区、读缓冲区和合并缓冲区都从这里申请
+constexpr size_t kMemoryBudgetBytes = 64u << 20;
+
+// 单个任务至少申请的额度；线程很多时，同时排序的任务数因此受预算限制，其余任务排队
+constexpr size_t kMinTaskLeaseBytes = 4u << 20;
+
+// 规划输入分段时假设的平均每个数的文本字节数（含分隔符）；
+// 实际更短时一段放不进一个 run 缓冲区，多出的部分先写成溢出文件再在任务内合并
+constexpr size_t kPlannedTextBytesPerValue = 16;
+
+// 一个数（含前导零）最多的字符数，超过视为格式错误
+constexpr size_t kMaxTokenBytes = 4096;
+
+// I/O 线程池的线程数
+constexpr size_t kIoThreads = 4;
+
+// 每个 run 缓冲区对应的进行中排序任务数：一个在用缓冲区，一个排队等缓冲区、缓冲区一空出来就能开始
+constexpr size_t kRunSourcesInFlightPerBuffer = 2;
+
+// 读写循环中每处理这么多个数检查一次取消
+constexpr size_t kCancelCheckInterval = 1 << 16;
+
+// 生成有序文件时的内存排序算法；支持 AVX-512 的机器上 Bitonic 排随机数据比 Radix 快，取值范围窄时 Radix 更快
+constexpr SortKernel kRunSortKernel = SortKernel::Radix;
+
+// 生成有序文件的方式：
+// ChunkSort 把一段输入整块读进内存排序，一段对应的输入不超过 run 缓冲区；
+// ReplacementSelection 用置换选择边读边输出，run 平均长度约为内存容量的两倍，
+// 每段输入因此可以规划得更大，叶子更少、合并层数更少，接近有序的输入一段只产生一个 run
+enum class RunGenerationMode {
+    ChunkSort,
+    ReplacementSelection
+};
+
+constexpr RunGenerationMode kRunGenerationMode = RunGenerationMode::ChunkSort;
+
+// 置换选择模式下每段输入规划产生的 run 个数（随机输入时），这些 run 在任务内一次多路合并
+constexpr size_t kSelectionRunsPerChunk = 4;
+
+// 置换选择模式下解析缓冲区能放下的数的个数
+constexpr size_t kSelectionBatchValues = 1 << 14;
+
+// 输入文本每次解析的字节数，解析完一块检查一次取消
+constexpr size_t kParseSliceBytes = 1 << 20;
+
+// 最终输出文件名；中间文件使用二进制 run 格式，只有它是文本
+constexpr const char *kFinalOutputName = "sorted_output.txt";
+
+// 输入文件中 [begin, end) 字节范围内开始的所有数
+struct InputRange {
+    std::string inputFilePath;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// 一个有序文件的来源。大文件被切成多段，各段独立排序，成为合并树上的不同叶子；
+// 小文件则多个拼在一起排序，有序文件的个数取决于总数据量而不是文件个数
+struct RunSource {
+    std::vector<InputRange> ranges;
+    std::string name;  // 有序文件名（不含扩展名）
+};
+
+// 由内存预算推出的各级缓冲区大小
+struct PipelineSizing {
+    size_t readBufferBytes;   // 排序任务每次读入的文本字节数
+    size_t runBuffers;        // 常驻的 run 缓冲区个数，即同时排序的任务数上限
+    size_t runValues;         // 每个 run 缓冲区最多能放下的数的个数
+    bool runScratch;          // run 缓冲区是否带同样大小的辅助数组（基数排序、双调排序）
+    size_t bytesPerValue;     // run 缓冲区中每个数占用的字节数（含辅助数组）
+    size_t runWriterBytes;    // 置换选择边读边写 run 的缓冲区大小，整块排序时为 0
+    size_t parseBatchValues;  // 置换选择的解析缓冲区能放下的数的个数，整块排序时为 0
+    size_t mergeBufferBytes;  // 合并时每个输入、输出文件的缓冲区大小
+    size_t mergeLeaseBytes;   // 两路合并申请的额度
+    uint64_t runChunkBytes;   // 每个有序文件对应的输入字节数
+    size_t workspaceBytes;    // 各工作线程常驻的排序工作区（基数排序的直方图），不经过 MemoryBudget
+};
+
+// 先从预算中扣除各工作线程常驻的排序工作区，剩下的交给 MemoryBudget：
+// run 缓冲区由 RunBufferPool 常驻持有，其余额度留给排序任务的读缓冲区和合并任务；
+// 所有 run 缓冲区都在使用时仍至少放得下一个合并任务，合并不会因为排序占满预算而停下。
+// 预算太小时抛出 std::invalid_argument
+PipelineSizing planPipeline(size_t budgetBytes, size_t workers, RunGenerationMode mode, SortKernel kernel) {
+    PipelineSizing sizing;
+    bool radix = mode == RunGenerationMode::ChunkSort && kernel == SortKernel::Radix;
+    sizing.workspaceBytes = radix ? workers * radixHistogramBytes() : 0;
+    if (sizing.workspaceBytes >= budgetBytes) {
+        throw std::invalid_argument("Memory budget of " + std::to_string(budgetBytes) + " bytes is too small");
     }
+    budgetBytes -= sizing.workspaceBytes;
+    size_t taskBytes = std::min(budgetBytes, std::max(budgetBytes / workers, kMinTaskLeaseBytes));
+    sizing.runBuffers = std::max<size_t>(1, std::min(workers, budgetBytes / taskBytes));
+    sizing.readBufferBytes = std::clamp<size_t>(taskBytes / 16, 16u << 10, 4u << 20);
+    sizing.mergeBufferBytes = std::clamp<size_t>(taskBytes / 3, 4u << 10, kRunBufferBytes);
+    sizing.mergeLeaseBytes = 3 * sizing.mergeBufferBytes;
+
+    // 读缓冲区之外还要容纳上一块末尾留下的、以及跨过范围末尾的不完整的数
+    size_t readBytes = sizing.readBufferBytes + 2 * kMaxTokenBytes;
+    if (mode == RunGenerationMode::ReplacementSelection) {
+        // 堆中每个数只占 8 字节，另有写 run 的缓冲区和解析缓冲区
+        sizing.runScratch = false;
+        sizing.bytesPerValue = sizeof(int64_t);
+        sizing.runWriterBytes = sizing.readBufferBytes;
+        sizing.parseBatchValues = kSelectionBatchValues;
+    } else {
+        // 基数排序和双调排序需要同样大小的辅助数组
+        sizing.runScratch = kernel != SortKernel::StdSort;
+        sizing.bytesPerValue = sizing.runScratch ? 2 * sizeof(int64_t) : sizeof(int64_t);
+        sizing.runWriterBytes = 0;
+        sizing.parseBatchValues = 0;
+    }
+    size_t fixedBytes = readBytes + sizing.runWriterBytes + sizing.parseBatchValues * sizeof(int64_t);
+    if (budgetBytes < sizing.mergeLeaseBytes + sizing.runBuffers * (fixedBytes + sizing.bytesPerValue * 1024)) {
+        throw std::invalid_argument("Memory budget of " + std::to_string(budgetBytes) + " bytes is too small");
+    }
+    size_t bufferBytes = std::min(taskBytes, (budgetBytes - sizing.mergeLeaseBytes) / sizing.runBuffers) - fixedBytes;
+    sizing.runValues = bufferBytes / sizing.bytesPerValue;
+    sizing.runChunkBytes = sizing.runValues * kPlannedTextBytesPerValue;
+    if (mode == RunGenerationMode::ReplacementSelection) {
+        sizing.runChunkBytes *= 2 * kSelectionRunsPerChunk;
+    }
+    return sizing;
+}
+
+// 排序任务在 run 缓冲区之外申请的额度：读缓冲区（输入很少时按最长的一段申请）以及置换选择的写缓冲区和解析缓冲区。
+// 读完输入后同一份额度用来合并溢出文件，至少要放得下两个输入和一个输出的最小缓冲区
+size_t planSortLeaseBytes(const PipelineSizing &sizing, const RunSource &source) {
+    uint64_t maxRangeBytes = 0;
+    for (const auto &range : source.ranges) {
+        maxRangeBytes = std::max(maxRangeBytes, range.end - range.begin);
+    }
+    size_t readBytes = static_cast<size_t>(std::min<uint64_t>(sizing.readBufferBytes, maxRangeBytes)) + 2 * kMaxTokenBytes;
+    return std::max(readBytes + sizing.runWriterBytes + sizing.parseBatchValues * sizeof(int64_t), 3 * kMinRunBufferBytes);
+}
+
+// 排序作业共用的线程池、内存预算和缓冲区大小
+struct SortContext {
+    LockFreeThreadPool &pool;
+    ThreadPool &ioPool;
+    MemoryBudget &budget;
+    RunBufferPool &runBuffers;
+    PipelineSizing sizing;
+};
+
+// 分块读取 [begin, end) 范围的文本，在 I/O 线程上执行，每块不超过 pieceBytes（加上一个数的长度）。
+// 范围边界会移到空白处：跨过 begin 的数属于上一段，跨过 end 的数属于这一段；
+// 每一块都只包含完整的数，被块边界截断的数留到下一块
+class InputRangeReader {
+public:
+    InputRangeReader(const InputRange &range, size_t pieceBytes)
+        : range(range), pieceBytes(pieceBytes), position(0), skipLeading(range.begin > 0), reachedEof(false), finished(false) {}
+
+    // 读取下一块到 piece，没有更多数据时返回 false
+    bool next(std::string &piece) {
+        if (finished) {
+            return false;
+        }
+        if (!file.is_open()) {
+            file.open(range.inputFilePath, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Error opening input file: " + range.inputFilePath);
+            }
+            // 多读 begin 前面的一个字节，用来判断 begin 是否落在一个数的中间
+            position = range.begin > 0 ? range.begin - 1 : 0;
+            file.seekg(static_cast<std::streamoff>(position));
+        }
 
-    std::vector<int64_t> data;
-    int64_t value;
+        // piece 保留自己的容量，carry 只有一个数那么长
+        piece.assign(carry);
+        carry.clear();
+        while (true) {
+            if (position < range.end) {
+                size_t carried = piece.size();
+                size_t want = static_cast<size_t>(std::min<uint64_t>(pieceBytes, range.end - position));
+                piece.resize(carried + want);
+                file.read(piece.data() + carried, static_cast<std::streamsize>(want));
+                size_t got = static_cast<size_t>(file.gcount());
+                piece.resize(carried + got);
+                position += got;
+                if (got < want) {
+                    if (file.bad()) {
+                        throw std::runtime_error("Error reading input file: " + range.inputFilePath);
+                    }
+                    position = range.end;  // 文件比规划时短
+                    reachedEof = true;
+                }
+            }
+
+            if (skipLeading) {
+                size_t skip = 0;
+                while (skip < piece.size() && !std::isspace(static_cast<unsigned char>(piece[skip]))) {
+                    ++skip;
+                }
+                piece.erase(0, skip);
+                if (piece.empty() && position < range.end) {
+                    continue;  // 读到的全是上一段的数，继续跳过
+                }
+                skipLeading = false;
+            }
 
-    // 读取文件中的数据到内存
-    while (inFile >> value) {
-        data.push_back(value);
+            if (position < range.end) {
+                size_t cut = piece.size();
+                while (cut > 0 && !std::isspace(static_cast<unsigned char>(piece[cut - 1]))) {
+                    --cut;
+                }
+                if (cut == 0) {
+                    if (piece.size() > kMaxTokenBytes) {
+                        throw std::runtime_error("Malformed data in input file: " + range.inputFilePath);
+                    }
+                    continue;  // 还没有读到一个完整的数
+                }
+                carry.assign(piece, cut, std::string::npos);
+                piece.resize(cut);
+                return true;
+            }
+
+            // 到达范围末尾：最后一个数可能延续到范围之外，读到空白或文件结尾为止
+            if (!reachedEof && !piece.empty() && !std::isspace(static_cast<unsigned char>(piece.back()))) {
+                extendToWhitespace(piece);
+            }
+            finished = true;
+            return !piece.empty();
+        }
     }
-    inFile.close();
 
-    // 对数据进行排序
-    std::sort(data.begin(), data.end());
+private:
+    const InputRange &range;
+    size_t pieceBytes;
+    std::ifstream file;
+    uint64_t position;  // 下一次读取的文件偏移
+    bool skipLeading;   // 还没有跳过开头属于上一段的数
+    bool reachedEof;
+    bool finished;
+    std::string carry;  // 上一块末尾不完整的数
+
+    void extendToWhitespace(std::string &piece) {
+        char extra[64];
+        size_t extended = 0;
+        while (true) {
+            file.read(extra, sizeof(extra));
+            size_t got = static_cast<size_t>(file.gcount());
+            size_t used = 0;
+            while (used < got && !std::isspace(static_cast<unsigned char>(extra[used]))) {
+                ++used;
+            }
+            piece.append(extra, used);
+            extended += used;
+            if (used < got || got < sizeof(extra)) {
+                break;
+            }
+            if (extended > kMaxTokenBytes) {
+                throw std::runtime_error("Malformed data in input file: " + range.inputFilePath);
+            }
+        }
+    }
+};
+
+// 排序 values 并写成一个 run，写完后清空 values（保留容量）。
+// 输入本来有序（或逆序、只有少数几个有序段）时跳过排序或直接归并，返回预扫描的结果供日志使用
+Task<Presortedness> writeSortedRun(SortContext &ctx, std::vector<int64_t> &values, std::vector<int64_t> &scratch, const std::string &path, const CancellationToken &token) {
+    Presortedness order = sortValuesAdaptive(values, scratch, kRunSortKernel);
+    token.throwIfCancelled();
+    co_await blockingCall(ctx.ioPool, ctx.pool, [&path, &values] {
+        writeRun(path, values);
+    });
+    values.clear();
+    co_return order;
+}
 
-    // 写入排序后的数据
-    std::ofstream sortedFile(outputFilePath);
-    if (!sortedFile.is_open()) {
-        std::cerr << "Error opening output file: " << outputFilePath << std::endl;
-        return;
+// 日志中对输入有序程度的说明
+std::string describePresortedness(const Presortedness &order) {
+    if (order.naturalRuns == 1) {
+        return order.reversedRuns == 1 ? " (input was reverse-sorted)" : " (input was already sorted)";
+    }
+    if (order.naturalRuns > 1) {
+        return " (merged " + std::to_string(order.naturalRuns) + " natural runs)";
     }
+    return "";
+}
+
+// 合并时计算线程只处理已经读入缓冲区的数据：输入的缓冲区取完或输出的缓冲区写满时挂起，
+// 由 I/O 线程池读入下一段或写出缓冲区，计算线程在这期间可以处理其他任务
 
-    for (const auto &val : data) {
-        sortedFile << val << "\n";
+// writer 的缓冲区写满时在 I/O 线程上写出
+template<typename Writer>
+Task<void> flushIfFull(SortContext &ctx, Writer &writer, TaskPriority priority) {
+    if (writer.room() == 0) {
+        co_await blockingCall(ctx.ioPool, ctx.pool, [&writer] { writer.flush(); }, priority);
     }
+}
 
-    sortedFile.close();
-    std::cout << "Finished writing sorted file: " << outputFilePath << std::endl;
+// 把 reader 中小于 bound 的前缀（没有 bound 时是剩余的全部数据）整段写入 writer，不逐个比较
+template<typename Writer>
+Task<void> copyRun(SortContext &ctx, RunReader &reader, Writer &writer, std::optional<int64_t> bound, TaskPriority priority, CancellationToken token) {
+    while (true) {
+        if (!reader.ready()) {
+            co_await blockingCall(ctx.ioPool, ctx.pool, [&reader] { reader.refill(); }, priority);
+        }
+        co_await flushIfFull(ctx, writer, priority);
+        const int64_t *values;
+        size_t count = std::min(reader.peekBlock(values), writer.room());
+        if (count == 0) {
+            co_return;
+        }
+        size_t n = bound ? static_cast<size_t>(std::lower_bound(values, values + count, *bound) - values) : count;
+        writer.writeBlock(values, n);
+        reader.consume(n);
+        token.throwIfCancelled();
+        if (n < count) {
+            co_return;
+        }
+    }
 }
 
-void mergeTwoFiles(const std::string &file1, const std::string &file2, const std::string &outputFilePath) {
-    std::ifstream inFile1(file1);
-    std::ifstream inFile2(file2);
-    std::ofstream outFile(outputFilePath);
+// 把 readers 合并到 writer，各 reader 要先处于 ready() 状态
+template<typename Writer>
+Task<void> mergeReaders(SortContext &ctx, const std::vector<RunReader *> &readers, Writer &writer, TaskPriority priority, CancellationToken token) {
+    if (readers.size() == 2) {
+        // 两个 run 的取值范围不重叠时直接拼接，不必逐个比较
+        RunReader &reader1 = *readers[0];
+        RunReader &reader2 = *readers[1];
+        const RunHeader &header1 = reader1.header();
+        const RunHeader &header2 = reader2.header();
+        if (header1.count == 0 || header2.count == 0 || header1.max <= header2.min) {
+            co_await copyRun(ctx, reader1, writer, std::nullopt, priority, token);
+            co_await copyRun(ctx, reader2, writer, std::nullopt, priority, token);
+            co_return;
+        }
+        if (header2.max < header1.min) {
+            co_await copyRun(ctx, reader2, writer, std::nullopt, priority, token);
+            co_await copyRun(ctx, reader1, writer, std::nullopt, priority, token);
+            co_return;
+        }
+        // 部分重叠时，只有重叠的区间需要逐个比较：最小值较小的 run 中低于另一个 run 最小值的前缀直接复制。
+        // 本来有序的输入切出的相邻段往往只在边界处重叠
+        if (header1.min < header2.min) {
+            co_await copyRun(ctx, reader1, writer, header2.min, priority, token);
+        } else if (header2.min < header1.min) {
+            co_await copyRun(ctx, reader2, writer, header1.min, priority, token);
+        }
+    }
 
-    if (!inFile1.is_open() || !inFile2.is_open() || !outFile.is_open()) {
-        std::cerr << "Error opening files for merging." << std::endl;
-        return;
+    LoserTree tree(readers, true);
+    while (tree.hasNext()) {
+        co_await flushIfFull(ctx, writer, priority);
+        tree.writeNext(writer, std::min(writer.room(), kCancelCheckInterval));
+        if (RunReader *reader = tree.starvedReader()) {
+            co_await blockingCall(ctx.ioPool, ctx.pool, [reader] { reader->refill(); }, priority);
+            tree.resume();
+        }
+        token.throwIfCancelled();
     }
+}
 
-    int64_t value1, value2;
-    bool hasValue1 = static_cast<bool>(inFile1 >> value1);
-    bool hasValue2 = static_cast<bool>(inFile2 >> value2);
+// 把若干个 run 合并成一个，中间层和溢出文件输出 run，最终输出文本；每个输入和输出各用 bufferBytes 字节的缓冲区。
+// 打开、读写文件都在 I/O 线程池上进行，计算线程只做比较、编解码和格式化。
+// 出错时抛出 std::runtime_error；token 被取消时抛出 OperationCancelled 并删除未写完的输出
+Task<void> mergeRunFiles(SortContext &ctx, const std::vector<std::string> &paths, const std::string &outputFilePath, OutputFormat format, size_t bufferBytes, TaskPriority priority, CancellationToken token) {
+    std::vector<std::unique_ptr<RunReader>> readers = co_await blockingCall(ctx.ioPool, ctx.pool, [&paths, bufferBytes] {
+        std::vector<std::unique_ptr<RunReader>> opened;
+        for (const auto &path : paths) {
+            opened.push_back(std::make_unique<RunReader>(path, bufferBytes));
+            opened.back()->refill();
+        }
+        return opened;
+    }, priority);
+    std::vector<RunReader *> inputs;
+    for (auto &reader : readers) {
+        inputs.push_back(reader.get());
+    }
 
-    while (hasValue1 && hasValue2) {
-        if (value1 < value2) {
-            outFile << value1 << "\n";
-            hasValue1 = static_cast<bool>(inFile1 >> value1);
-        } else {
-            outFile << value2 << "\n";
-            hasValue2 = static_cast<bool>(inFile2 >> value2);
+    if (format == OutputFormat::BinaryRun) {
+        // RunWriter 未 close 就析构时会删除文件
+        std::unique_ptr<RunWriter> writer = co_await blockingCall(ctx.ioPool, ctx.pool, [&outputFilePath, bufferBytes] {
+            return std::make_unique<RunWriter>(outputFilePath, bufferBytes);
+        }, priority);
+        co_await mergeReaders(ctx, inputs, *writer, priority, token);
+        co_await blockingCall(ctx.ioPool, ctx.pool, [&writer] { writer->close(); }, priority);
+    } else {
+        std::unique_ptr<TextWriter> writer = co_await blockingCall(ctx.ioPool, ctx.pool, [&outputFilePath, bufferBytes] {
+            return std::make_unique<TextWriter>(outputFilePath, bufferBytes);
+        }, priority);
+        try {
+            co_await mergeReaders(ctx, inputs, *writer, priority, token);
+            co_await blockingCall(ctx.ioPool, ctx.pool, [&writer] { writer->close(); }, priority);
+        } catch (...) {
+            writer.reset();
+            fs::remove(outputFilePath);
+            throw;
+        }
+    }
+}
+
+// 任务结束时删除溢出文件
+struct SpillFiles {
+    std::vector<std::string> paths;
+
+    ~SpillFiles() {
+        for (const auto &path : paths) {
+            std::error_code ec;
+            fs::remove(path, ec);
         }
     }
+};
+
+// 在 leaseBytes 的额度内把溢出文件合并成 outputFilePath。每个输入和输出的缓冲区都不能小于 kMinRunBufferBytes，
+// 额度放不下所有输入时先每 fanIn 个合并成一个中间文件，直到一次能合并完
+Task<void> mergeSpills(SortContext &ctx, SpillFiles &spills, const std::string &outputFilePath, size_t leaseBytes, CancellationToken token) {
+    const size_t fanIn = std::max<size_t>(2, leaseBytes / kMinRunBufferBytes - 1);
+    size_t merged = 0;
+    while (spills.paths.size() > fanIn) {
+        std::vector<std::string> group(spills.paths.begin(), spills.paths.begin() + static_cast<std::ptrdiff_t>(fanIn));
+        spills.paths.push_back(outputFilePath + ".spillmerge" + std::to_string(merged++));
+        co_await mergeRunFiles(ctx, group, spills.paths.back(), OutputFormat::BinaryRun, leaseBytes / (fanIn + 1),
+                               TaskPriority::RunGeneration, token);
+        co_await blockingCall(ctx.ioPool, ctx.pool, [&group] {
+            for (const auto &path : group) {
+                fs::remove(path);
+            }
+        });
+        spills.paths.erase(spills.paths.begin(), spills.paths.begin() + static_cast<std::ptrdiff_t>(fanIn));
+    }
+    co_await mergeRunFiles(ctx, spills.paths, outputFilePath, OutputFormat::BinaryRun, leaseBytes / (spills.paths.size() + 1),
+                           TaskPriority::RunGeneration, token);
+}
 
-    while (hasValue1) {
-        outFile << value1 << "\n";
-        hasValue1 = static_cast<bool>(inFile1 >> value1);
+// 生成一个有序文件（大文件的一段或若干个小文件）：读、写交给 I/O 线程池，协程挂起期间计算线程可以处理其他文件；
+// 解析和排序在计算线程池上完成，结果以二进制 run 格式写出。
+// 任务开始时从 RunBufferPool 取一个预留好容量的 run 缓冲区，再按 planSortLeaseBytes 为读缓冲区申请额度，
+// 缓冲区都不会再增长；这一段的数比规划的多、run 缓冲区放不下时，先排序写成溢出文件，
+// 最后归还 run 缓冲区，在额度内把溢出文件合并成一个 run。
+// 出错时抛出 std::runtime_error，取消时抛出 OperationCancelled
+Task<void> sortFile(SortContext &ctx, const RunSource &source, const std::string &outputFilePath, CancellationToken token) {
+    RunBufferHandle buffer = co_await takeRunBuffer(ctx.runBuffers, ctx.pool);
+    MemoryLease lease = co_await acquireMemory(ctx.budget, ctx.pool, planSortLeaseBytes(ctx.sizing, source));
+    token.throwIfCancelled();
+
+    // 缓冲区第一次由执行解析的工作线程写入，线程绑定核心后页面落在本地 NUMA 节点上，之后归还给同一个线程复用
+    std::vector<int64_t> &values = buffer->values;
+    std::vector<int64_t> &scratch = buffer->scratch;
+    SpillFiles spills;
+
+    for (const auto &range : source.ranges) {
+        InputRangeReader reader(range, ctx.sizing.readBufferBytes);
+        std::string piece;
+        while (co_await blockingCall(ctx.ioPool, ctx.pool, [&reader, &piece] { return reader.next(piece); })) {
+            token.throwIfCancelled();
+
+            // 按块解析，块之间检查取消，块边界不会切断数字。
+            // [pos, pos + n) 中开始的数最多 (n + 1) / 2 个，据此保证解析不会超出 run 缓冲区的容量
+            const char *pos = piece.data();
+            const char *end = piece.data() + piece.size();
+            while (pos != end) {
+                size_t room = values.capacity() - values.size();
+                if (room == 0) {
+                    spills.paths.push_back(outputFilePath + ".spill" + std::to_string(spills.paths.size()));
+                    co_await writeSortedRun(ctx, values, scratch, spills.paths.back(), token);
+                    continue;
+                }
+                const char *sliceEnd = pos + std::min<size_t>({kParseSliceBytes, static_cast<size_t>(end - pos), 2 * room - 1});
+                while (sliceEnd != end && !std::isspace(static_cast<unsigned char>(*sliceEnd))) {
+                    ++sliceEnd;
+                }
+                parseDecimalInts(pos, sliceEnd, values, range.inputFilePath);
+                pos = sliceEnd;
+                token.throwIfCancelled();
+            }
+        }
     }
 
-    while (hasValue2) {
-        outFile << value2 << "\n";
-        hasValue2 = static_cast<bool>(inFile2 >> value2);
+    if (spills.paths.empty()) {
+        Presortedness order = co_await writeSortedRun(ctx, values, scratch, outputFilePath, token);
+        std::cout << "Finished writing sorted file: " << outputFilePath << describePresortedness(order) << std::endl;
+    } else {
+        spills.paths.push_back(outputFilePath + ".spill" + std::to_string(spills.paths.size()));
+        co_await writeSortedRun(ctx, values, scratch, spills.paths.back(), token);
+
+        // run 缓冲区先还给其他排序任务，多路合并只用读缓冲区的额度
+        buffer.reset();
+        co_await mergeSpills(ctx, spills, outputFilePath, lease.size(), token);
+        std::cout << "Finished writing sorted file: " << outputFilePath << std::endl;
     }
+}
 
-    inFile1.close();
-    inFile2.close();
-    outFile.close();
+// 用置换选择生成一个有序文件：解析出的数分批送进堆，run 边读边写出（写在计算线程上进行）。
+// 只产生一个 run 时（输入接近有序，或这一段不超过堆的容量）它就是结果；
+// 否则归还堆数组（一个 run 缓冲区），在同一份额度内把这些 run 一次多路合并成一个。
+// 出错时抛出 std::runtime_error，取消时抛出 OperationCancelled
+Task<void> selectRuns(SortContext &ctx, const RunSource &source, const std::string &outputFilePath, CancellationToken token) {
+    RunBufferHandle buffer = co_await takeRunBuffer(ctx.runBuffers, ctx.pool);
+    MemoryLease lease = co_await acquireMemory(ctx.budget, ctx.pool, planSortLeaseBytes(ctx.sizing, source));
+    token.throwIfCancelled();
+
+    SpillFiles runs;
+    {
+        ReplacementSelection selection(buffer->values, ctx.sizing.runWriterBytes, [&runs, &outputFilePath] {
+            runs.paths.push_back(outputFilePath + ".spill" + std::to_string(runs.paths.size()));
+            return runs.paths.back();
+        });
+        std::vector<int64_t> batch;
+        batch.reserve(ctx.sizing.parseBatchValues);
+
+        for (const auto &range : source.ranges) {
+            InputRangeReader reader(range, ctx.sizing.readBufferBytes);
+            std::string piece;
+            while (co_await blockingCall(ctx.ioPool, ctx.pool, [&reader, &piece] { return reader.next(piece); })) {
+                token.throwIfCancelled();
+
+                // 每次解析的数不超过解析缓冲区的容量，规则与 sortFile 相同
+                const char *pos = piece.data();
+                const char *end = piece.data() + piece.size();
+                while (pos != end) {
+                    const char *sliceEnd = pos + std::min<size_t>({kParseSliceBytes, static_cast<size_t>(end - pos), 2 * batch.capacity() - 1});
+                    while (sliceEnd != end && !std::isspace(static_cast<unsigned char>(*sliceEnd))) {
+                        ++sliceEnd;
+                    }
+                    parseDecimalInts(pos, sliceEnd, batch, range.inputFilePath);
+                    selection.add(batch.data(), batch.size());
+                    batch.clear();
+                    pos = sliceEnd;
+                    token.throwIfCancelled();
+                }
+            }
+        }
+        selection.finish();
+    }
+    buffer.reset();
+
+    if (runs.paths.empty()) {
+        writeRun(outputFilePath, {});  // 输入中没有数
+    } else if (runs.paths.size() == 1) {
+        fs::rename(runs.paths.front(), outputFilePath);
+        runs.paths.clear();
+    } else {
+        co_await mergeSpills(ctx, runs, outputFilePath, lease.size(), token);
+    }
+    std::cout << "Finished writing sorted file: " << outputFilePath << " (" << std::max<size_t>(runs.paths.size(), 1) << " runs)" << std::endl;
+}
 
+// 合并任务：先申请读写缓冲区的额度，再合并。
+// 每个 run 只被一个合并节点读取，合并成功后立即删除两个输入，磁盘上不会留下每一层合并的完整副本
+Task<void> mergeTask(SortContext &ctx, const std::string &file1, const std::string &file2, const std::string &outputFilePath, OutputFormat format, TaskPriority priority, CancellationToken token) {
+    {
+        MemoryLease lease = co_await acquireMemory(ctx.budget, ctx.pool, ctx.sizing.mergeLeaseBytes, priority);
+        token.throwIfCancelled();
+        std::vector<std::string> inputs;
+        inputs.push_back(file1);
+        inputs.push_back(file2);
+        co_await mergeRunFiles(ctx, inputs, outputFilePath, format, ctx.sizing.mergeBufferBytes, priority, token);
+    }
     std::cout << "Finished merging files into: " << outputFilePath << std::endl;
+    co_await blockingCall(ctx.ioPool, ctx.pool, [&file1, &file2] {
+        fs::remove(file1);
+        fs::remove(file2);
+    }, priority);
 }
 
-void incrementalMerge(ThreadPool &mergePool, std::deque<std::string> &sortedFilePaths, const std::string &outputDirectoryPath, int &mergeCounter) {
-    while (sortedFilePaths.size() > 1) {
-        std::string file1 = sortedFilePaths.front();
-        sortedFilePaths.pop_front();
-        std::string file2 = sortedFilePaths.front();
-        sortedFilePaths.pop_front();
-
-        std::string outputFilePath = outputDirectoryPath + "/merge_0_" + std::to_string(mergeCounter++) + ".txt";
-        
-        // 合并两个文件并将合并结果添加到合并队列
-        mergePool.enqueueTask([file1, file2, outputFilePath, &sortedFilePaths]() mutable {
-            mergeTwoFiles(file1, file2, outputFilePath);
-            sortedFilePaths.push_back(outputFilePath);
-        });
+// 只有一个有序文件时没有合并步骤，直接把它转成文本输出，成功后删除这个 run
+Task<void> writeTextOutput(SortContext &ctx, const std::string &runPath, const std::string &outputFilePath, CancellationToken token) {
+    {
+        MemoryLease lease = co_await acquireMemory(ctx.budget, ctx.pool, ctx.sizing.mergeLeaseBytes, TaskPriority::FinalMerge);
+        token.throwIfCancelled();
+        std::vector<std::string> inputs(1, runPath);
+        co_await mergeRunFiles(ctx, inputs, outputFilePath, OutputFormat::Text, ctx.sizing.mergeBufferBytes, TaskPriority::FinalMerge, token);
     }
+    co_await blockingCall(ctx.ioPool, ctx.pool, [&runPath] { fs::remove(runPath); }, TaskPriority::FinalMerge);
+}
+
+// 尚未与其他文件合并的有序文件，level 为它已经经历的两两合并层数
+struct PendingRun {
+    TaskHandle node;          // 产生该文件的任务
+    const std::string *path;  // 指向 runPaths 中的元素
+    size_t level;
+};
+
+// 为两个有序文件建立合并节点：两者都写完后，合并任务才会被提交
+// 任务只捕获路径指针，提交时不复制字符串
+// 合并树的根（最后建立的合并节点）使用最高优先级并直接写出最终的文本文件，其余为中间层合并
+PendingRun scheduleMerge(SortContext &ctx, TaskGroup &jobs, std::deque<std::string> &runPaths, PendingRun first, PendingRun second, const std::string &outputDirectoryPath, int &mergeCounter, int totalMerges) {
+    size_t level = std::max(first.level, second.level) + 1;
+    bool isFinal = (mergeCounter + 1 == totalMerges);
+    TaskPriority priority = isFinal ? TaskPriority::FinalMerge : TaskPriority::IntermediateMerge;
+    OutputFormat format = isFinal ? OutputFormat::Text : OutputFormat::BinaryRun;
+    if (isFinal) {
+        runPaths.push_back(outputDirectoryPath + "/" + kFinalOutputName);
+        ++mergeCounter;
+    } else {
+        runPaths.push_back(outputDirectoryPath + "/merge_" + std::to_string(level) + "_" + std::to_string(mergeCounter++) + ".run");
+    }
+    const std::string *outputFilePath = &runPaths.back();
+
+    TaskHandle node = jobs.whenAllAsync({first.node, second.node}, [&ctx, file1 = first.path, file2 = second.path, outputFilePath, format, priority, token = jobs.token()] {
+        return mergeTask(ctx, *file1, *file2, *outputFilePath, format, priority, token);
+    }, priority);
+    return {node, outputFilePath, level};
 }
 
 int main() {
@@ -111,45 +630,172 @@ int main() {
         fs::create_directory(outputDirectoryPath);
     }
 
-    std::vector<std::string> filePaths;
+    // 排序和合并共用一个线程池，由任务优先级决定先做什么，所有核心始终有活可干
+    size_t totalThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    // 各级缓冲区按内存预算和线程数确定；预算不够时报错退出
+    PipelineSizing sizing;
+    try {
+        sizing = planPipeline(kMemoryBudgetBytes, totalThreads, kRunGenerationMode, kRunSortKernel);
+    } catch (const std::invalid_argument &e) {
+        std::cerr << "Invalid configuration: " << e.what() << std::endl;
+        return 1;
+    }
+    uint64_t runChunkBytes = sizing.runChunkBytes;
+
+    // 大文件按 runChunkBytes 切段，各段由不同的工作线程并行排序，
+    // 排序阶段的耗时取决于总数据量而不是最大的那个文件；
+    // 小文件依次装进同一个批次，攒够 runChunkBytes 再一起排序
+    std::vector<RunSource> runSources;
+    RunSource batch;
+    uint64_t batchBytes = 0;
+    size_t batchCounter = 0;
+
+    auto flushBatch = [&] {
+        if (batch.ranges.empty()) {
+            return;
+        }
+        if (batch.ranges.size() == 1) {
+            batch.name = "sorted_" + fs::path(batch.ranges.front().inputFilePath).stem().string();
+        } else {
+            batch.name = "sorted_batch_" + std::to_string(batchCounter++);
+        }
+        runSources.push_back(std::move(batch));
+        batch = RunSource();
+        batchBytes = 0;
+    };
 
     for (const auto &entry : fs::directory_iterator(inputDirectoryPath)) {
-        if (entry.is_regular_file()) {
-            filePaths.push_back(entry.path().string());
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::string path = entry.path().string();
+        uint64_t size = entry.file_size();
+        if (size > runChunkBytes) {
+            size_t parts = (size + runChunkBytes - 1) / runChunkBytes;
+            for (size_t part = 0; part < parts; ++part) {
+                uint64_t begin = size * part / parts;
+                uint64_t end = size * (part + 1) / parts;
+                runSources.push_back({{{path, begin, end}}, "sorted_" + entry.path().stem().string() + "_" + std::to_string(part)});
+            }
+            continue;
         }
+        if (batchBytes + size > runChunkBytes) {
+            flushBatch();
+        }
+        batch.ranges.push_back({path, 0, size});
+        batchBytes += size;
     }
-
-    size_t totalThreads = std::thread::hardware_concurrency();
-    size_t sortThreads = totalThreads * 1 / 2;  // 2/3用于文件排序
-    size_t mergeThreads = totalThreads - sortThreads;  // 1/3用于合并
+    flushBatch();
 
     int mergeCounter = 0; // 合并文件的编号
+    int totalMerges = static_cast<int>(runSources.size()) - 1;
+
+    // 排序阶段提交最密集，全局队列使用无锁环形队列。
+    // 排序任务一开始就会挂起（等 run 缓冲区、等读文件），挂起的任务不占队列，队列容量限制不了提交速度，
+    // 所以主线程自己限制进行中的排序任务数，见下面的 kRunSourcesInFlightPerBuffer
+    ThreadPoolOptions poolOptions;
+    poolOptions.pinWorkers = true;  // 绑定核心，排序缓冲区留在本地 NUMA 节点
+    poolOptions.dumpStatsOnShutdown = true;
+    LockFreeThreadPool pool(totalThreads, SchedulingMode::WorkStealing, totalThreads * 4, poolOptions);
+
+    // 读写文件的阻塞调用在单独的 I/O 线程池上执行，计算线程池只做计算
+    ThreadPool ioPool(kIoThreads);
+    MemoryBudget budget(kMemoryBudgetBytes - sizing.workspaceBytes);
+    std::vector<int> workerNodes;
+    for (size_t worker = 0; worker < pool.threadCount(); ++worker) {
+        workerNodes.push_back(pool.workerNode(worker));
+    }
+    RunBufferPool runBuffers(budget, sizing.runBuffers, sizing.runValues, sizing.runScratch, std::move(workerNodes),
+                             [&pool] { return pool.currentWorkerIndex(); });
+    SortContext ctx{pool, ioPool, budget, runBuffers, sizing};
+    TaskGroup jobs(pool);
+    std::cout << "Decimal parser: " << decimalParserName(activeDecimalParser()) << ", run generation: "
+              << (kRunGenerationMode == RunGenerationMode::ReplacementSelection ? "replacement selection" : sortKernelName(kRunSortKernel))
+              << std::endl;
+    std::cout << "Memory budget: " << (kMemoryBudgetBytes >> 20) << " MB, " << sizing.runBuffers << " run buffers of " << sizing.runValues
+              << " values, input chunk " << (runChunkBytes >> 10) << " KB, merge buffer "
+              << (sizing.mergeBufferBytes >> 10) << " KB, sort workspace " << (sizing.workspaceBytes >> 10) << " KB" << std::endl;
+
+    // 合并树由主线程在提交时一次性确定，类似二进制计数器：
+    // 栈顶两个文件层数相同就为它们建立合并节点，栈中最多保留 O(log n) 个文件
+    std::vector<PendingRun> pendingRuns;
+    std::deque<std::string> runPaths;  // 所有中间文件路径；deque 追加元素时不会使已有元素的地址失效
+
+    // 已提交、尚未完成的排序任务，按提交顺序排列。满了就等最早的那个完成再提交，
+    // 协程帧、挂起时登记的等待项和任务节点的个数都不随输入规模增长
+    std::deque<TaskHandle> runsInFlight;
+    const size_t maxRunsInFlight = kRunSourcesInFlightPerBuffer * sizing.runBuffers;
+
+    for (const auto &source : runSources) {
+        if (runsInFlight.size() >= maxRunsInFlight) {
+            jobs.waitFor(runsInFlight.front());
+            runsInFlight.pop_front();
+        }
+        if (jobs.isCancelled()) {
+            break;  // 已有任务失败，不再提交新任务
+        }
+        runPaths.push_back(outputDirectoryPath + "/" + source.name + ".run");
+        const std::string *outputFilePath = &runPaths.back();
+        TaskHandle node = jobs.spawnAsync([&ctx, source = &source, outputFilePath, token = jobs.token()] {
+            if (kRunGenerationMode == RunGenerationMode::ReplacementSelection) {
+                return selectRuns(ctx, *source, *outputFilePath, token);
+            }
+            return sortFile(ctx, *source, *outputFilePath, token);
+        }, TaskPriority::RunGeneration);
+        runsInFlight.push_back(node);
+        pendingRuns.push_back({node, outputFilePath, 0});
+
+        while (pendingRuns.size() > 1 && pendingRuns[pendingRuns.size() - 2].level == pendingRuns.back().level) {
+            PendingRun second = pendingRuns.back();
+            pendingRuns.pop_back();
+            PendingRun first = pendingRuns.back();
+            pendingRuns.pop_back();
+            pendingRuns.push_back(scheduleMerge(ctx, jobs, runPaths, first, second, outputDirectoryPath, mergeCounter, totalMerges));
+        }
+    }
 
-    ThreadPool sortPool(sortThreads);
-    ThreadPool mergePool(mergeThreads);
-
-    std::deque<std::string> sortedFilePaths;
-
-    // 开始文件排序并将结果加入合并队列
-    for (const auto &filePath : filePaths) {
-        std::string outputFilePath = outputDirectoryPath + "/sorted_" + fs::path(filePath).stem().string() + ".txt";
-        sortPool.enqueueTask([filePath, outputFilePath, &mergePool, &sortedFilePaths, &outputDirectoryPath, &mergeCounter]() mutable {
-            sortFile(filePath, outputFilePath);
-
-            // 排序完成后，加入合并队列
-            sortedFilePaths.push_back(outputFilePath);
+    // 收尾：把剩余层数不同的文件依次合并
+    while (pendingRuns.size() > 1 && !jobs.isCancelled()) {
+        PendingRun second = pendingRuns.back();
+        pendingRuns.pop_back();
+        PendingRun first = pendingRuns.back();
+        pendingRuns.pop_back();
+        pendingRuns.push_back(scheduleMerge(ctx, jobs, runPaths, first, second, outputDirectoryPath, mergeCounter, totalMerges));
+    }
 
-            if (sortedFilePaths.size() > 1) {
-                incrementalMerge(mergePool, sortedFilePaths, outputDirectoryPath, mergeCounter);
-            }
-        });
+    // 只有一个输入文件时把它的 run 转成最终的文本文件
+    if (pendingRuns.size() == 1 && pendingRuns.front().level == 0 && !jobs.isCancelled()) {
+        PendingRun run = pendingRuns.front();
+        runPaths.push_back(outputDirectoryPath + "/" + kFinalOutputName);
+        const std::string *outputFilePath = &runPaths.back();
+        TaskHandle node = jobs.whenAllAsync({run.node}, [&ctx, runPath = run.path, outputFilePath, token = jobs.token()] {
+            return writeTextOutput(ctx, *runPath, *outputFilePath, token);
+        }, TaskPriority::FinalMerge);
+        pendingRuns.front() = {node, outputFilePath, 1};
     }
 
-    sortPool.joinAll();  // 等待所有排序任务完成
-    mergePool.joinAll();  // 等待所有合并任务完成
+    // 等待所有排序和合并任务完成。成功时中间文件已由读取它的合并任务删除；
+    // 任一任务失败会取消整个作业，此时删除剩下的中间文件
+    try {
+        jobs.wait();
+    } catch (const std::exception &e) {
+        std::cerr << "Sort job failed: " << e.what() << std::endl;
+        pool.joinAll();
+        ioPool.joinAll();
+        for (const auto &path : runPaths) {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+        return 1;
+    }
+    pool.joinAll();
+    ioPool.joinAll();
 
-    if (!sortedFilePaths.empty()) {
-        std::cout << "Final output file: " << sortedFilePaths.front() << std::endl;
+    std::cout << "Peak memory budget usage: " << budget.peak() / double(1 << 20) << " MB of "
+              << (budget.limit() >> 20) << " MB" << std::endl;
+    if (!pendingRuns.empty()) {
+        std::cout << "Final output file: " << *pendingRuns.front().path << std::endl;
     }
 
     return 0;
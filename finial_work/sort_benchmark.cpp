@@ -0,0 +1,80 @@
+// sort_benchmark.cpp
+#include "SortKernel.h"
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <string>
+
+// 生成测试数据：全范围随机数，或者取值范围很小（高位恒定，基数排序可以跳过大部分趟）
+std::vector<int64_t> makeData(size_t count, bool narrowRange, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<int64_t> data(count);
+    for (auto &value : data) {
+        value = narrowRange ? static_cast<int64_t>(rng() % 1000000) - 500000 : static_cast<int64_t>(rng());
+    }
+    return data;
+}
+
+// 测试一种排序算法：对同一份数据重复排序若干次，取最短耗时
+void testSortPerformance(const std::string &name, const std::vector<int64_t> &input,
+                         const std::function<void(std::vector<int64_t> &, std::vector<int64_t> &)> &sort) {
+    int repeats = input.size() <= 100000 ? 10 : 3;
+    double best = 0;
+    std::vector<int64_t> scratch;
+    for (int i = 0; i < repeats; ++i) {
+        std::vector<int64_t> data = input;
+        auto start = std::chrono::high_resolution_clock::now();
+        sort(data, scratch);
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed = end - start;
+        if (i == 0 || elapsed.count() < best) {
+            best = elapsed.count();
+        }
+        if (!std::is_sorted(data.begin(), data.end())) {
+            std::cerr << name << " produced unsorted output!" << std::endl;
+            return;
+        }
+    }
+
+    // 输出耗时和每秒排序的数据量
+    std::cout << "  " << name << ": " << best << " seconds, "
+              << input.size() / best / 1e6 << " M values/s" << std::endl;
+}
+
+int main() {
+    const size_t sizes[] = {1000, 100000, 1000000, 10000000, 50000000};
+
+    for (bool narrowRange : {false, true}) {
+        for (size_t count : sizes) {
+            std::cout << (narrowRange ? "Narrow-range" : "Random") << " data, " << count << " values:" << std::endl;
+            std::vector<int64_t> input = makeData(count, narrowRange, count);
+
+            testSortPerformance("std::sort", input, [](std::vector<int64_t> &data, std::vector<int64_t> &) {
+                std::sort(data.begin(), data.end());
+            });
+            testSortPerformance("radix 8-bit", input, [](std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+                radixSort(data, scratch, RadixDigitBits::Bits8);
+            });
+            testSortPerformance("radix 11-bit", input, [](std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+                radixSort(data, scratch, RadixDigitBits::Bits11);
+            });
+            testSortPerformance("radix 16-bit", input, [](std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+                radixSort(data, scratch, RadixDigitBits::Bits16);
+            });
+            for (BitonicIsa isa : {BitonicIsa::Avx2, BitonicIsa::Avx512}) {
+                // 跳过 CPU 不支持的指令集
+                if (activeBitonicIsa() == BitonicIsa::Scalar || (isa == BitonicIsa::Avx512 && activeBitonicIsa() != BitonicIsa::Avx512)) {
+                    continue;
+                }
+                testSortPerformance(std::string("bitonic ") + bitonicIsaName(isa), input, [isa](std::vector<int64_t> &data, std::vector<int64_t> &scratch) {
+                    bitonicSort(isa, data, scratch);
+                });
+            }
+        }
+    }
+
+    return 0;
+}